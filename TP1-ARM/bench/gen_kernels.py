@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+Generates the long-running benchmark kernels in kernels/.
+
+For every kernel this writes <name>.s, assembles it into <name>.x with
+inputs/asm2hex and records the final state produced by the reference
+simulator in <name>.expected, which run_bench.py later checks against.
+
+    ./gen_kernels.py [--scale N]
+
+--scale multiplies the iteration counts (default 1, roughly 5-20M
+simulated instructions per kernel).
+"""
+
+import argparse, os, subprocess, sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, '..')
+ASM2HEX = os.path.join(ROOT, 'inputs', 'asm2hex')
+REF_SIM = os.path.join(ROOT, 'ref_sim_x86')
+KERNELS = os.path.join(HERE, 'kernels')
+
+DATA_START = 0x10000000
+
+
+def load_const(reg, value):
+    """movz/lsl sequence for a constant that fits in 32 bits."""
+    lines = []
+    if value >> 16:
+        lines.append('movz %s, 0x%x' % (reg, value >> 16))
+        lines.append('lsl %s, %s, 16' % (reg, reg))
+        if value & 0xffff:
+            lines.append('movz X28, 0x%x' % (value & 0xffff))
+            lines.append('orr %s, %s, X28' % (reg, reg))
+    else:
+        lines.append('movz %s, 0x%x' % (reg, value))
+    return lines
+
+
+def alu_loop(scale):
+    """Register-only arithmetic and logic, no memory traffic."""
+    iters = 1000000 * scale
+    return load_const('X9', iters) + [
+        'movz X1, 1',
+        'movz X2, 3',
+        'loop:',
+        'adds X1, X1, X2',
+        'eor X3, X1, X2',
+        'lsl X4, X3, 3',
+        'lsr X5, X4, 7',
+        'orr X2, X5, X1',
+        'mul X6, X2, X3',
+        'ands X7, X6, X1',
+        'add X2, X2, 5',
+        'subs X9, X9, 1',
+        'cbnz X9, loop',
+    ], (DATA_START, DATA_START)
+
+
+def memcpy(scale):
+    """Fill a buffer with STUR, then copy it word by word with LDUR/STUR."""
+    words = 0x2000                      # 64KB buffer
+    passes = 400 * scale
+    lines = load_const('X1', DATA_START)
+    lines += load_const('X2', DATA_START + words * 8)
+    lines += load_const('X9', words)
+    lines += [
+        'movz X3, 0x1357',
+        'add X10, X1, 0',
+        'fill:',
+        'stur X3, [X10, 0x0]',
+        'mul X3, X3, X3',
+        'add X3, X3, 0x3b',
+        'add X10, X10, 8',
+        'subs X9, X9, 1',
+        'cbnz X9, fill',
+    ]
+    lines += load_const('X11', passes)
+    lines += [
+        'pass:',
+        'add X10, X1, 0',
+        'add X12, X2, 0',
+    ]
+    lines += load_const('X9', words // 4)
+    lines += [
+        'copy:',
+        'ldur X4, [X10, 0x0]',
+        'ldur X5, [X10, 0x8]',
+        'ldur X6, [X10, 0x10]',
+        'ldur X7, [X10, 0x18]',
+        'stur X4, [X12, 0x0]',
+        'stur X5, [X12, 0x8]',
+        'stur X6, [X12, 0x10]',
+        'stur X7, [X12, 0x18]',
+        'add X10, X10, 0x20',
+        'add X12, X12, 0x20',
+        'subs X9, X9, 1',
+        'cbnz X9, copy',
+        'subs X11, X11, 1',
+        'cbnz X11, pass',
+        'ldur X20, [X2, 0x0]',
+        'ldur X21, [X12, -0x8]',
+    ]
+    return lines, (DATA_START + words * 8 - 0x20, DATA_START + words * 8 + 0x20)
+
+
+def branchy(scale):
+    """Data-dependent conditional branches driven by a multiplicative hash."""
+    iters = 700000 * scale
+    return load_const('X9', iters) + [
+        'movz X1, 0x4d2',
+        'movz X13, 0x6b',
+        'movz X20, 0',
+        'movz X21, 0',
+        'movz X22, 0',
+        'movz X23, 0',
+        'movz X15, 1',
+        'loop:',
+        'mul X1, X1, X13',
+        'add X1, X1, 0x7f1',
+        'lsr X2, X1, 17',
+        'movz X14, 0xff',
+        'ands X3, X2, X14',
+        'subs X4, X3, 0x80',
+        'blt low',
+        'cmp X4, 0x40',
+        'bgt high',
+        'add X20, X20, 1',
+        'b next',
+        'low:',
+        'cmp X3, 0x20',
+        'ble verylow',
+        'add X21, X21, 1',
+        'b next',
+        'verylow:',
+        'add X22, X22, 1',
+        'b next',
+        'high:',
+        'add X23, X23, 1',
+        'next:',
+        'ands X5, X2, X15',
+        'beq even',
+        'eor X24, X24, X2',
+        'even:',
+        'subs X9, X9, 1',
+        'bne loop',
+    ], (DATA_START, DATA_START)
+
+
+def bytes_traffic(scale):
+    """Byte-granular STURB/LDURB traffic: a byte histogram of a generated buffer."""
+    size = 0x8000
+    passes = 24 * scale
+    lines = load_const('X1', DATA_START)                 # source bytes
+    lines += load_const('X2', DATA_START + 0x10000)      # 256 byte counters
+    lines += load_const('X11', passes)
+    lines += [
+        'movz X3, 0x2a',
+        'pass:',
+        'add X10, X1, 0',
+    ]
+    lines += load_const('X9', size)
+    lines += [
+        'gen:',
+        'add X3, X3, 0x1d',
+        'eor X3, X3, X9',
+        'sturb W3, [X10, 0x0]',
+        'add X10, X10, 1',
+        'subs X9, X9, 1',
+        'cbnz X9, gen',
+        'add X10, X1, 0',
+    ]
+    lines += load_const('X9', size)
+    lines += [
+        'count:',
+        'ldurb W4, [X10, 0x0]',
+        'add X5, X2, X4',
+        'ldurb W6, [X5, 0x0]',
+        'add X6, X6, 1',
+        'sturb W6, [X5, 0x0]',
+        'add X10, X10, 1',
+        'subs X9, X9, 1',
+        'cbnz X9, count',
+        'subs X11, X11, 1',
+        'cbnz X11, pass',
+    ]
+    return lines, (DATA_START + 0x10000, DATA_START + 0x10000 + 0xfc)
+
+
+KERNEL_TABLE = [
+    ('alu_loop', alu_loop),
+    ('memcpy', memcpy),
+    ('branchy', branchy),
+    ('bytes', bytes_traffic),
+]
+
+
+def final_state(sim, program, mem_range, extra_args=()):
+    """Run a program to completion and return its rdump/mdump lines."""
+    cmds = 'go\nrdump\nmdump 0x%x 0x%x\nquit\n' % mem_range
+    out = subprocess.run([sim] + list(extra_args) + [program], input=cmds,
+                         capture_output=True, text=True, check=True).stdout
+    keep = []
+    for line in out.splitlines():
+        line = line.strip()
+        if line.startswith(('Instruction Count', 'PC', 'X', 'FLAG_', '0x')):
+            keep.append(line)
+    return keep
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--scale', type=int, default=1)
+    args = parser.parse_args()
+
+    os.makedirs(KERNELS, exist_ok=True)
+    for name, kernel in KERNEL_TABLE:
+        body, mem_range = kernel(args.scale)
+        base = os.path.join(KERNELS, name)
+        with open(base + '.s', 'w') as f:
+            f.write('.text\n')
+            for line in body + ['HLT 0']:
+                f.write(line + '\n' if line.endswith(':') else '    ' + line + '\n')
+        subprocess.check_call([ASM2HEX, base + '.s'], cwd=KERNELS)
+        state = final_state(REF_SIM, base + '.x', mem_range)
+        with open(base + '.expected', 'w') as f:
+            f.write('# mdump 0x%x 0x%x\n' % mem_range)
+            f.write('\n'.join(state) + '\n')
+        print('%-10s %s' % (name, state[0]))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,19 @@
+.text
+    movz X9, 0xf
+    lsl X9, X9, 16
+    movz X28, 0x4240
+    orr X9, X9, X28
+    movz X1, 1
+    movz X2, 3
+loop:
+    adds X1, X1, X2
+    eor X3, X1, X2
+    lsl X4, X3, 3
+    lsr X5, X4, 7
+    orr X2, X5, X1
+    mul X6, X2, X3
+    ands X7, X6, X1
+    add X2, X2, 5
+    subs X9, X9, 1
+    cbnz X9, loop
+    HLT 0
@@ -0,0 +1,17 @@
+d28001e9 
+d370bd29 
+d288481c 
+aa1c0129 
+d2800021 
+d2800062 
+ab020021 
+ca020023 
+d37df064 
+d347fc85 
+aa0100a2 
+9b037c46 
+ea0100c7 
+91001442 
+f1000529 
+b5fffee9 
+d4400000 
\ No newline at end of file
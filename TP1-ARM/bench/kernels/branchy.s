@@ -0,0 +1,42 @@
+.text
+    movz X9, 0xa
+    lsl X9, X9, 16
+    movz X28, 0xae60
+    orr X9, X9, X28
+    movz X1, 0x4d2
+    movz X13, 0x6b
+    movz X20, 0
+    movz X21, 0
+    movz X22, 0
+    movz X23, 0
+    movz X15, 1
+loop:
+    mul X1, X1, X13
+    add X1, X1, 0x7f1
+    lsr X2, X1, 17
+    movz X14, 0xff
+    ands X3, X2, X14
+    subs X4, X3, 0x80
+    blt low
+    cmp X4, 0x40
+    bgt high
+    add X20, X20, 1
+    b next
+low:
+    cmp X3, 0x20
+    ble verylow
+    add X21, X21, 1
+    b next
+verylow:
+    add X22, X22, 1
+    b next
+high:
+    add X23, X23, 1
+next:
+    ands X5, X2, X15
+    beq even
+    eor X24, X24, X2
+even:
+    subs X9, X9, 1
+    bne loop
+    HLT 0
@@ -0,0 +1,35 @@
+d2800149 
+d370bd29 
+d295cc1c 
+aa1c0129 
+d2809a41 
+d2800d6d 
+d2800014 
+d2800015 
+d2800016 
+d2800017 
+d280002f 
+9b0d7c21 
+911fc421 
+d351fc22 
+d2801fee 
+ea0e0043 
+f1020064 
+540000ab 
+f101009f 
+5400012c 
+91000694 
+14000008 
+f100807f 
+5400006d 
+910006b5 
+14000004 
+910006d6 
+14000002 
+910006f7 
+ea0f0045 
+54000040 
+ca020318 
+f1000529 
+54fffd41 
+d4400000 
\ No newline at end of file
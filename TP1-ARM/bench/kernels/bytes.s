@@ -0,0 +1,31 @@
+.text
+    movz X1, 0x1000
+    lsl X1, X1, 16
+    movz X2, 0x1001
+    lsl X2, X2, 16
+    movz X11, 0x18
+    movz X3, 0x2a
+pass:
+    add X10, X1, 0
+    movz X9, 0x8000
+gen:
+    add X3, X3, 0x1d
+    eor X3, X3, X9
+    sturb W3, [X10, 0x0]
+    add X10, X10, 1
+    subs X9, X9, 1
+    cbnz X9, gen
+    add X10, X1, 0
+    movz X9, 0x8000
+count:
+    ldurb W4, [X10, 0x0]
+    add X5, X2, X4
+    ldurb W6, [X5, 0x0]
+    add X6, X6, 1
+    sturb W6, [X5, 0x0]
+    add X10, X10, 1
+    subs X9, X9, 1
+    cbnz X9, count
+    subs X11, X11, 1
+    cbnz X11, pass
+    HLT 0
@@ -0,0 +1,27 @@
+d2820001 
+d370bc21 
+d2820022 
+d370bc42 
+d280030b 
+d2800543 
+9100002a 
+d2900009 
+91007463 
+ca090063 
+38000143 
+9100054a 
+f1000529 
+b5ffff69 
+9100002a 
+d2900009 
+38400144 
+8b040045 
+384000a6 
+910004c6 
+380000a6 
+9100054a 
+f1000529 
+b5ffff29 
+f100056b 
+b5fffdab 
+d4400000 
\ No newline at end of file
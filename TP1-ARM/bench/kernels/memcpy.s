@@ -0,0 +1,38 @@
+.text
+    movz X1, 0x1000
+    lsl X1, X1, 16
+    movz X2, 0x1001
+    lsl X2, X2, 16
+    movz X9, 0x2000
+    movz X3, 0x1357
+    add X10, X1, 0
+fill:
+    stur X3, [X10, 0x0]
+    mul X3, X3, X3
+    add X3, X3, 0x3b
+    add X10, X10, 8
+    subs X9, X9, 1
+    cbnz X9, fill
+    movz X11, 0x190
+pass:
+    add X10, X1, 0
+    add X12, X2, 0
+    movz X9, 0x800
+copy:
+    ldur X4, [X10, 0x0]
+    ldur X5, [X10, 0x8]
+    ldur X6, [X10, 0x10]
+    ldur X7, [X10, 0x18]
+    stur X4, [X12, 0x0]
+    stur X5, [X12, 0x8]
+    stur X6, [X12, 0x10]
+    stur X7, [X12, 0x18]
+    add X10, X10, 0x20
+    add X12, X12, 0x20
+    subs X9, X9, 1
+    cbnz X9, copy
+    subs X11, X11, 1
+    cbnz X11, pass
+    ldur X20, [X2, 0x0]
+    ldur X21, [X12, -0x8]
+    HLT 0
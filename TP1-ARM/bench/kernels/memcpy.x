@@ -0,0 +1,34 @@
+d2820001 
+d370bc21 
+d2820022 
+d370bc42 
+d2840009 
+d2826ae3 
+9100002a 
+f8000143 
+9b037c63 
+9100ec63 
+9100214a 
+f1000529 
+b5ffff69 
+d280320b 
+9100002a 
+9100004c 
+d2810009 
+f8400144 
+f8408145 
+f8410146 
+f8418147 
+f8000184 
+f8008185 
+f8010186 
+f8018187 
+9100814a 
+9100818c 
+f1000529 
+b5fffea9 
+f100056b 
+b5fffe0b 
+f8400054 
+f85f8195 
+d4400000 
\ No newline at end of file
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+Runs the kernels in kernels/ on our simulator and reports simulated MIPS.
+
+Every kernel is run once per execution mode; its final registers and the
+memory range recorded in <name>.expected must match the reference run,
+otherwise the kernel is reported as FAIL and the exit status is non-zero.
+
+    ./run_bench.py [--sim ../src/sim] [--mode undo --mode no-undo]
+                   [--repeat N] [--json results.json] [kernel ...]
+"""
+
+import argparse, json, os, subprocess, sys, tempfile
+
+from gen_kernels import HERE, KERNELS, KERNEL_TABLE, final_state
+
+# execution mode -> extra simulator arguments
+MODES = {
+    'undo': ['--undo'],
+    'no-undo': [],
+}
+
+
+def read_expected(name):
+    with open(os.path.join(KERNELS, name + '.expected')) as f:
+        lines = f.read().splitlines()
+    low, high = lines[0].split()[2:4]
+    return (int(low, 16), int(high, 16)), lines[1:]
+
+
+def run_kernel(sim, name, mode):
+    mem_range, expected = read_expected(name)
+    with tempfile.NamedTemporaryFile(suffix='.json') as stats_file:
+        args = MODES[mode] + ['--stats-json', stats_file.name]
+        state = final_state(sim, os.path.join(KERNELS, name + '.x'), mem_range, args)
+        stats = json.load(open(stats_file.name))
+    return state == expected, stats
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--sim', default=os.path.join(HERE, '..', 'src', 'sim'))
+    parser.add_argument('--mode', action='append', choices=sorted(MODES))
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='runs per kernel and mode, the fastest is reported')
+    parser.add_argument('--json', help='also write the results to this file')
+    parser.add_argument('kernels', nargs='*')
+    args = parser.parse_args()
+
+    modes = args.mode or sorted(MODES)
+    kernels = args.kernels or [name for name, _ in KERNEL_TABLE]
+
+    results, failed = [], False
+    print('%-10s %-8s %6s %12s %10s %9s' %
+          ('kernel', 'mode', 'state', 'instructions', 'host s', 'MIPS'))
+    for name in kernels:
+        for mode in modes:
+            best = None
+            for _ in range(args.repeat):
+                ok, stats = run_kernel(args.sim, name, mode)
+                failed |= not ok
+                if best is None or stats['host_ns'] < best['host_ns']:
+                    best = stats
+            print('%-10s %-8s %6s %12d %10.3f %9.2f' %
+                  (name, mode, 'ok' if ok else 'FAIL', best['instructions'],
+                   best['host_ns'] / 1e9, best['mips']))
+            results.append(dict(kernel=name, mode=mode, ok=ok, **best))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=2)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,672 @@
+/***************************************************************/
+/*                                                             */
+/*   ARM Instruction Level Simulator                           */
+/*                                                             */
+/*   Differential fuzzer against the reference simulator       */
+/*                                                             */
+/***************************************************************/
+
+/*
+ * Generates random programs from the implemented instruction subset, runs
+ * each one on this simulator (linked in, no shell) and on ref_sim_x86, and
+ * compares registers, flags, PC, instruction count and a window of data
+ * memory. Programs are built so they always terminate: memory accesses go
+ * through X1, which points at MEM_DATA_START and is never overwritten, and
+ * every branch jumps forward.
+ *
+ * Each worker process generates a batch of programs, starts one reference
+ * simulator per program all at once so their start-up costs overlap, and
+ * then checks the results. A mismatch is minimized by deleting instructions
+ * while it still reproduces and is saved as fuzz-<seed>.x/.s/.txt.
+ *
+ *   fuzz [-n programs] [-j jobs] [-b batch] [-l max_len] [-s seed]
+ *        [-r ref_sim] [-o out_dir]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "shell.h"
+#include "undo.h"
+#include "stats.h"
+
+extern char **environ;
+
+#define FUZZ_MAX_LEN      64
+#define FUZZ_MAX_BATCH    64
+#define FUZZ_MAX_STEPS    1000
+#define FUZZ_WINDOW_WORDS 20    /* data window checked after each run */
+#define FUZZ_OUTPUT_SIZE  8192
+
+enum {
+    FUZZ_ADD_IMM, FUZZ_ADDS_IMM, FUZZ_SUBS_IMM,
+    FUZZ_ADD_REG, FUZZ_ADDS_REG, FUZZ_SUBS_REG,
+    FUZZ_ANDS, FUZZ_ORR, FUZZ_EOR,
+    FUZZ_LSL, FUZZ_LSR, FUZZ_MOVZ, FUZZ_MUL,
+    FUZZ_STUR, FUZZ_STURH, FUZZ_STURB,
+    FUZZ_LDUR, FUZZ_LDURH, FUZZ_LDURB,
+    FUZZ_B, FUZZ_BCOND, FUZZ_CBZ, FUZZ_CBNZ,
+    FUZZ_NUM_KINDS
+};
+
+typedef struct {
+    int kind;
+    int rd, rn, rm;
+    int cond, shift;
+    int64_t imm;
+    int target;         /* branches: index of the destination instruction */
+} fuzz_insn_t;
+
+/* insn[0..len-1] followed by an implicit HLT; the first `fixed` ones set up X1 */
+typedef struct {
+    fuzz_insn_t insn[FUZZ_MAX_LEN];
+    int len, fixed;
+    uint64_t seed;
+} fuzz_prog_t;
+
+typedef struct {
+    uint64_t pc, count;
+    int64_t regs[ARM_REGS];
+    int flag_n, flag_z;
+    uint32_t mem[FUZZ_WINDOW_WORDS];
+} fuzz_state_t;
+
+static const int CONDS[] = { 0x0, 0x1, 0xa, 0xb, 0xc, 0xd };   /* EQ NE GE LT GT LE */
+static const char *COND_NAMES[16] = {
+    "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
+    "hi", "ls", "ge", "lt", "gt", "le", "al", "nv"
+};
+
+static const char *REF_SIM = "../ref_sim_x86";
+static const char *OUT_DIR = ".";
+static int MAX_LEN = 24;
+
+/***************************************************************/
+/* Random program generation                                   */
+/***************************************************************/
+
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static int rng_range(uint64_t *state, int n)
+{
+    return (int)(rng_next(state) % (uint64_t)n);
+}
+
+/* any register but X1; XZR shows up now and then */
+static int random_reg(uint64_t *rng)
+{
+    int r;
+
+    if (rng_range(rng, 16) == 0)
+        return 31;
+    do {
+        r = rng_range(rng, 8);      /* few registers, so values get reused */
+    } while (r == 1);
+    return r;
+}
+
+static void random_insn(uint64_t *rng, fuzz_insn_t *in, int index, int len)
+{
+    memset(in, 0, sizeof(*in));
+    in->kind = rng_range(rng, FUZZ_NUM_KINDS);
+    in->rd = random_reg(rng);
+    in->rn = random_reg(rng);
+    in->rm = random_reg(rng);
+
+    switch (in->kind) {
+    case FUZZ_ADD_IMM: case FUZZ_ADDS_IMM: case FUZZ_SUBS_IMM:
+        in->shift = rng_range(rng, 4) == 0;
+        in->imm = rng_range(rng, 4096);
+        break;
+    case FUZZ_LSL: case FUZZ_LSR:
+        in->imm = rng_range(rng, 64);
+        break;
+    case FUZZ_MOVZ:
+        in->imm = rng_next(rng) & 0xffff;
+        break;
+    case FUZZ_STUR: case FUZZ_STURH: case FUZZ_STURB:
+    case FUZZ_LDUR: case FUZZ_LDURH: case FUZZ_LDURB:
+        /* mostly a handful of aligned slots, so loads see earlier stores */
+        in->rn = 1;
+        in->imm = rng_range(rng, 4) == 0 ? rng_range(rng, 64) : rng_range(rng, 8) * 8;
+        break;
+    case FUZZ_B: case FUZZ_BCOND: case FUZZ_CBZ: case FUZZ_CBNZ:
+        in->cond = CONDS[rng_range(rng, sizeof(CONDS) / sizeof(CONDS[0]))];
+        in->target = index + 1 + rng_range(rng, len - index);
+        break;
+    }
+}
+
+static void generate(uint64_t seed, fuzz_prog_t *prog)
+{
+    uint64_t rng = seed | 1;
+    int i, body;
+
+    prog->seed = seed;
+    prog->len = 0;
+
+    /* X1 = MEM_DATA_START */
+    prog->insn[0] = (fuzz_insn_t){ .kind = FUZZ_MOVZ, .rd = 1, .imm = MEM_DATA_START >> 16 };
+    prog->insn[1] = (fuzz_insn_t){ .kind = FUZZ_LSL, .rd = 1, .rn = 1, .imm = 16 };
+    prog->fixed = prog->len = 2;
+
+    /* seed a few registers with non-zero values */
+    for (i = 0; i < 4; i++) {
+        fuzz_insn_t *in = &prog->insn[prog->len++];
+        memset(in, 0, sizeof(*in));
+        in->kind = FUZZ_MOVZ;
+        in->rd = random_reg(&rng);
+        in->imm = rng_next(&rng) & 0xffff;
+    }
+
+    body = 1 + rng_range(&rng, MAX_LEN);
+    for (i = 0; i < body; i++, prog->len++)
+        random_insn(&rng, &prog->insn[prog->len], prog->len, prog->fixed + 4 + body);
+}
+
+/* Drop instruction `index`, retargeting branches that pointed past it */
+static void remove_insn(fuzz_prog_t *prog, int index)
+{
+    int i;
+
+    memmove(&prog->insn[index], &prog->insn[index + 1],
+            (prog->len - index - 1) * sizeof(fuzz_insn_t));
+    prog->len--;
+    for (i = 0; i < prog->len; i++)
+        if (prog->insn[i].target > index)
+            prog->insn[i].target--;
+}
+
+/***************************************************************/
+/* Encoding                                                    */
+/***************************************************************/
+
+static uint32_t encode(const fuzz_prog_t *prog, int index)
+{
+    const fuzz_insn_t *in = &prog->insn[index];
+    uint32_t rd = in->rd, rn = in->rn << 5, rm = in->rm << 16;
+    uint32_t imm9 = ((uint32_t)in->imm & 0x1ff) << 12;
+    uint32_t off19 = ((uint32_t)(in->target - index) & 0x7ffff) << 5;
+
+    switch (in->kind) {
+    case FUZZ_ADD_IMM:  return 0x91000000 | in->shift << 22 | (uint32_t)in->imm << 10 | rn | rd;
+    case FUZZ_ADDS_IMM: return 0xb1000000 | in->shift << 22 | (uint32_t)in->imm << 10 | rn | rd;
+    case FUZZ_SUBS_IMM: return 0xf1000000 | in->shift << 22 | (uint32_t)in->imm << 10 | rn | rd;
+    case FUZZ_ADD_REG:  return 0x8b000000 | rm | rn | rd;
+    case FUZZ_ADDS_REG: return 0xab000000 | rm | rn | rd;
+    case FUZZ_SUBS_REG: return 0xeb000000 | rm | rn | rd;
+    case FUZZ_ANDS:     return 0xea000000 | rm | rn | rd;
+    case FUZZ_ORR:      return 0xaa000000 | rm | rn | rd;
+    case FUZZ_EOR:      return 0xca000000 | rm | rn | rd;
+    case FUZZ_LSL:      return 0xd3400000 | ((64 - in->imm) & 63) << 16 | (63 - in->imm) << 10 | rn | rd;
+    case FUZZ_LSR:      return 0xd3400000 | in->imm << 16 | 63 << 10 | rn | rd;
+    case FUZZ_MOVZ:     return 0xd2800000 | (uint32_t)in->imm << 5 | rd;
+    case FUZZ_MUL:      return 0x9b007c00 | rm | rn | rd;
+    case FUZZ_STUR:     return 0xf8000000 | imm9 | rn | rd;
+    case FUZZ_STURH:    return 0x78000000 | imm9 | rn | rd;
+    case FUZZ_STURB:    return 0x38000000 | imm9 | rn | rd;
+    case FUZZ_LDUR:     return 0xf8400000 | imm9 | rn | rd;
+    case FUZZ_LDURH:    return 0x78400000 | imm9 | rn | rd;
+    case FUZZ_LDURB:    return 0x38400000 | imm9 | rn | rd;
+    case FUZZ_B:        return 0x14000000 | ((uint32_t)(in->target - index) & 0x3ffffff);
+    case FUZZ_BCOND:    return 0x54000000 | off19 | in->cond;
+    case FUZZ_CBZ:      return 0xb4000000 | off19 | rd;
+    case FUZZ_CBNZ:     return 0xb5000000 | off19 | rd;
+    }
+    return 0;
+}
+
+static int assemble(const fuzz_prog_t *prog, uint32_t *code)
+{
+    int i;
+
+    for (i = 0; i < prog->len; i++)
+        code[i] = encode(prog, i);
+    code[prog->len] = 0xd4400000;   /* HLT */
+    return prog->len + 1;
+}
+
+static void print_insn(FILE *out, const fuzz_prog_t *prog, int index)
+{
+    static const char *names[FUZZ_NUM_KINDS] = {
+        "add", "adds", "subs", "add", "adds", "subs", "ands", "orr", "eor",
+        "lsl", "lsr", "movz", "mul", "stur", "sturh", "sturb",
+        "ldur", "ldurh", "ldurb", "b", "b.", "cbz", "cbnz"
+    };
+    const fuzz_insn_t *in = &prog->insn[index];
+    const char *w = in->kind == FUZZ_STURH || in->kind == FUZZ_STURB ||
+                    in->kind == FUZZ_LDURH || in->kind == FUZZ_LDURB ? "W" : "X";
+
+    if (index == prog->len) {
+        fprintf(out, "L%d:\n    HLT 0\n", index);
+        return;
+    }
+    fprintf(out, "L%d:\n    ", index);
+    switch (in->kind) {
+    case FUZZ_ADD_IMM: case FUZZ_ADDS_IMM: case FUZZ_SUBS_IMM:
+        fprintf(out, "%s X%d, X%d, %" PRId64 "%s\n", names[in->kind], in->rd, in->rn, in->imm,
+                in->shift ? ", lsl 12" : "");
+        break;
+    case FUZZ_ADD_REG: case FUZZ_ADDS_REG: case FUZZ_SUBS_REG:
+    case FUZZ_ANDS: case FUZZ_ORR: case FUZZ_EOR: case FUZZ_MUL:
+        fprintf(out, "%s X%d, X%d, X%d\n", names[in->kind], in->rd, in->rn, in->rm);
+        break;
+    case FUZZ_LSL: case FUZZ_LSR:
+        fprintf(out, "%s X%d, X%d, %" PRId64 "\n", names[in->kind], in->rd, in->rn, in->imm);
+        break;
+    case FUZZ_MOVZ:
+        fprintf(out, "movz X%d, 0x%" PRIx64 "\n", in->rd, in->imm);
+        break;
+    case FUZZ_STUR: case FUZZ_STURH: case FUZZ_STURB:
+    case FUZZ_LDUR: case FUZZ_LDURH: case FUZZ_LDURB:
+        fprintf(out, "%s %s%d, [X%d, 0x%" PRIx64 "]\n", names[in->kind], w, in->rd, in->rn, in->imm);
+        break;
+    case FUZZ_B:
+        fprintf(out, "b L%d\n", in->target);
+        break;
+    case FUZZ_BCOND:
+        fprintf(out, "b.%s L%d\n", COND_NAMES[in->cond], in->target);
+        break;
+    case FUZZ_CBZ: case FUZZ_CBNZ:
+        fprintf(out, "%s X%d, L%d\n", names[in->kind], in->rd, in->target);
+        break;
+    }
+}
+
+/***************************************************************/
+/* Running on this simulator                                   */
+/***************************************************************/
+
+static void run_local(const uint32_t *code, int ncode, fuzz_state_t *state)
+{
+    int i;
+
+    memset(&CURRENT_STATE, 0, sizeof(CURRENT_STATE));
+    CURRENT_STATE.PC = MEM_TEXT_START;
+    NEXT_STATE = CURRENT_STATE;
+    INSTRUCTION_COUNT = 0;
+    RUN_BIT = TRUE;
+    undo_reset();
+
+    for (i = 0; i < ncode; i++)
+        mem_write_32(MEM_TEXT_START + 4 * i, code[i]);
+    while (RUN_BIT && INSTRUCTION_COUNT < FUZZ_MAX_STEPS)
+        cycle();
+
+    state->pc = CURRENT_STATE.PC;
+    state->count = INSTRUCTION_COUNT;
+    memcpy(state->regs, CURRENT_STATE.REGS, sizeof(state->regs));
+    state->flag_n = CURRENT_STATE.FLAG_N;
+    state->flag_z = CURRENT_STATE.FLAG_Z;
+    for (i = 0; i < FUZZ_WINDOW_WORDS; i++) {
+        state->mem[i] = mem_read_32(MEM_DATA_START + 4 * i);
+        mem_write_32(MEM_DATA_START + 4 * i, 0);
+    }
+    for (i = 0; i < ncode; i++)
+        mem_write_32(MEM_TEXT_START + 4 * i, 0);
+}
+
+/***************************************************************/
+/* Running on the reference simulator                          */
+/***************************************************************/
+
+typedef struct {
+    pid_t pid;
+    int out_fd;
+} ref_run_t;
+
+static int write_program(const char *path, const uint32_t *code, int ncode)
+{
+    FILE *f = fopen(path, "w");
+    int i;
+
+    if (f == NULL)
+        return -1;
+    for (i = 0; i < ncode; i++)
+        fprintf(f, "%08x\n", code[i]);
+    fclose(f);
+    return 0;
+}
+
+/* Start ref_sim on `path` with its commands already queued on stdin */
+static int ref_start(const char *path, ref_run_t *run)
+{
+    char commands[128];
+    char *argv[] = { (char *)REF_SIM, (char *)path, NULL };
+    posix_spawn_file_actions_t actions;
+    int in[2], out[2], len, err;
+
+    if (pipe(in) < 0 || pipe(out) < 0)
+        return -1;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, out[1], 2);
+    posix_spawn_file_actions_addclose(&actions, in[1]);
+    posix_spawn_file_actions_addclose(&actions, out[0]);
+    err = posix_spawn(&run->pid, REF_SIM, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in[0]);
+    close(out[1]);
+    if (err != 0) {
+        close(in[1]);
+        close(out[0]);
+        errno = err;
+        return -1;
+    }
+
+    /* a few dozen bytes always fit in the pipe, so this never blocks */
+    len = snprintf(commands, sizeof(commands), "run %d\nrdump\nmdump 0x%x 0x%x\nquit\n",
+                   FUZZ_MAX_STEPS, MEM_DATA_START, MEM_DATA_START + 4 * (FUZZ_WINDOW_WORDS - 1));
+    if (write(in[1], commands, len) != len)
+        perror("write");
+    close(in[1]);
+    fcntl(out[0], F_SETFD, FD_CLOEXEC);
+    run->out_fd = out[0];
+    return 0;
+}
+
+/* Collect the output of a ref_sim started by ref_start. Returns -1 if it crashed. */
+static int ref_finish(ref_run_t *run, fuzz_state_t *state)
+{
+    static char output[FUZZ_OUTPUT_SIZE];
+    size_t used = 0;
+    ssize_t n;
+    int status, parsed = 0;
+    char *line;
+
+    while ((n = read(run->out_fd, output + used, sizeof(output) - 1 - used)) > 0)
+        used += n;
+    output[used] = '\0';
+    close(run->out_fd);
+    waitpid(run->pid, &status, 0);
+    if (!WIFEXITED(status))
+        return -1;
+
+    memset(state, 0, sizeof(*state));
+    for (line = strtok(output, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        unsigned int reg, address, word;
+        uint64_t value;
+        char *p = line;
+
+        while (*p == ' ' || *p == '>')
+            p++;
+        if (sscanf(p, "Instruction Count : %" SCNu64, &state->count) == 1)
+            parsed++;
+        else if (sscanf(p, "PC : 0x%" SCNx64, &state->pc) == 1)
+            parsed++;
+        else if (sscanf(p, "X%u: 0x%" SCNx64, &reg, &value) == 2 && reg < ARM_REGS) {
+            state->regs[reg] = (int64_t)value;
+            parsed++;
+        }
+        else if (sscanf(p, "FLAG_N: %d", &state->flag_n) == 1)
+            parsed++;
+        else if (sscanf(p, "FLAG_Z: %d", &state->flag_z) == 1)
+            parsed++;
+        else if (sscanf(p, "0x%x (%*d) : 0x%x", &address, &word) == 2 &&
+                 address >= MEM_DATA_START && address < MEM_DATA_START + 4 * FUZZ_WINDOW_WORDS)
+            state->mem[(address - MEM_DATA_START) / 4] = word;
+    }
+    return parsed == ARM_REGS + 4 ? 0 : -1;
+}
+
+static int ref_run(const char *path, const uint32_t *code, int ncode, fuzz_state_t *state)
+{
+    ref_run_t run;
+
+    if (write_program(path, code, ncode) < 0 || ref_start(path, &run) < 0)
+        return -1;
+    return ref_finish(&run, state);
+}
+
+/***************************************************************/
+/* Comparison and minimization                                 */
+/***************************************************************/
+
+static int describe_diff(FILE *out, const fuzz_state_t *ours, const fuzz_state_t *ref)
+{
+    int k, diffs = 0;
+
+    if (ours->count != ref->count && ++diffs && out)
+        fprintf(out, "Instruction Count: ours %" PRIu64 " ref %" PRIu64 "\n", ours->count, ref->count);
+    if (ours->pc != ref->pc && ++diffs && out)
+        fprintf(out, "PC: ours 0x%" PRIx64 " ref 0x%" PRIx64 "\n", ours->pc, ref->pc);
+    for (k = 0; k < ARM_REGS; k++)
+        if (ours->regs[k] != ref->regs[k] && ++diffs && out)
+            fprintf(out, "X%d: ours 0x%" PRIx64 " ref 0x%" PRIx64 "\n", k, ours->regs[k], ref->regs[k]);
+    if (ours->flag_n != ref->flag_n && ++diffs && out)
+        fprintf(out, "FLAG_N: ours %d ref %d\n", ours->flag_n, ref->flag_n);
+    if (ours->flag_z != ref->flag_z && ++diffs && out)
+        fprintf(out, "FLAG_Z: ours %d ref %d\n", ours->flag_z, ref->flag_z);
+    for (k = 0; k < FUZZ_WINDOW_WORDS; k++)
+        if (ours->mem[k] != ref->mem[k] && ++diffs && out)
+            fprintf(out, "0x%08x: ours 0x%x ref 0x%x\n", MEM_DATA_START + 4 * k, ours->mem[k], ref->mem[k]);
+    return diffs;
+}
+
+static int mismatches(const fuzz_prog_t *prog, const char *path)
+{
+    uint32_t code[FUZZ_MAX_LEN + 1];
+    fuzz_state_t ours, ref;
+    int ncode = assemble(prog, code);
+
+    run_local(code, ncode, &ours);
+    if (ref_run(path, code, ncode, &ref) < 0)
+        return 1;       /* the reference crashing counts as a mismatch */
+    return describe_diff(NULL, &ours, &ref) != 0;
+}
+
+static void minimize(fuzz_prog_t *prog, const char *path)
+{
+    int i, progress = TRUE;
+
+    while (progress) {
+        progress = FALSE;
+        for (i = prog->len - 1; i >= prog->fixed; i--) {
+            fuzz_prog_t candidate = *prog;
+
+            remove_insn(&candidate, i);
+            if (mismatches(&candidate, path)) {
+                *prog = candidate;
+                progress = TRUE;
+            }
+        }
+    }
+}
+
+static void report(fuzz_prog_t *prog, const char *scratch)
+{
+    uint32_t code[FUZZ_MAX_LEN + 1];
+    fuzz_state_t ours, ref;
+    char path[512];
+    FILE *out;
+    int i, ncode, crashed;
+
+    minimize(prog, scratch);
+    ncode = assemble(prog, code);
+    run_local(code, ncode, &ours);
+    crashed = ref_run(scratch, code, ncode, &ref) < 0;
+
+    snprintf(path, sizeof(path), "%s/fuzz-%016" PRIx64 ".x", OUT_DIR, prog->seed);
+    write_program(path, code, ncode);
+
+    snprintf(path, sizeof(path), "%s/fuzz-%016" PRIx64 ".s", OUT_DIR, prog->seed);
+    if ((out = fopen(path, "w")) != NULL) {
+        fprintf(out, ".text\n");
+        for (i = 0; i <= prog->len; i++)
+            print_insn(out, prog, i);
+        fclose(out);
+    }
+
+    snprintf(path, sizeof(path), "%s/fuzz-%016" PRIx64 ".txt", OUT_DIR, prog->seed);
+    if ((out = fopen(path, "w")) != NULL) {
+        if (crashed)
+            fprintf(out, "reference simulator crashed\n");
+        else
+            describe_diff(out, &ours, &ref);
+        fclose(out);
+    }
+
+    printf("mismatch: seed 0x%016" PRIx64 ", %d instructions after minimizing -> %s/fuzz-%016" PRIx64 ".*\n",
+           prog->seed, ncode, OUT_DIR, prog->seed);
+    fflush(stdout);
+}
+
+/***************************************************************/
+/* Workers                                                     */
+/***************************************************************/
+
+/* Fuzz `count` programs in batches; returns the number of mismatches */
+static int fuzz_worker(uint64_t seed, long count, int batch)
+{
+    static fuzz_prog_t progs[FUZZ_MAX_BATCH];
+    static uint32_t code[FUZZ_MAX_BATCH][FUZZ_MAX_LEN + 1];
+    static ref_run_t runs[FUZZ_MAX_BATCH];
+    char dir[] = "/tmp/armfuzz.XXXXXX", path[64];
+    uint64_t rng = seed | 1;
+    long done = 0;
+    int i, n, found = 0;
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    /* every ref_sim writes ./dumpsim; keep each worker's in its own directory
+       (the runs of one batch still share it, but only their stdout is read) */
+    if (chdir(dir) != 0) {
+        perror("chdir");
+        rmdir(dir);
+        exit(2);
+    }
+    init_memory();
+
+    while (done < count) {
+        n = count - done < batch ? (int)(count - done) : batch;
+
+        for (i = 0; i < n; i++) {
+            int ncode;
+
+            generate(rng_next(&rng), &progs[i]);
+            ncode = assemble(&progs[i], code[i]);
+            snprintf(path, sizeof(path), "%s/%d.x", dir, i);
+            if (write_program(path, code[i], ncode) < 0 || ref_start(path, &runs[i]) < 0) {
+                perror(REF_SIM);
+                exit(2);
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            fuzz_state_t ours, ref;
+            int ncode = assemble(&progs[i], code[i]);
+            int crashed = ref_finish(&runs[i], &ref) < 0;
+
+            run_local(code[i], ncode, &ours);
+            if (crashed || describe_diff(NULL, &ours, &ref)) {
+                snprintf(path, sizeof(path), "%s/min.x", dir);
+                report(&progs[i], path);
+                found++;
+            }
+        }
+        done += n;
+    }
+
+    for (i = 0; i < batch; i++) {
+        snprintf(path, sizeof(path), "%s/%d.x", dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/min.x", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/dumpsim", dir);
+    unlink(path);
+    rmdir(dir);
+    return found;
+}
+
+static void usage(const char *argv0)
+{
+    printf("Error: usage: %s [-n programs] [-j jobs] [-b batch] [-l max_len] [-s seed]"
+           " [-r ref_sim] [-o out_dir]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    long programs = 10000;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int batch = 32, opt, j, found = 0, broken = 0;
+    uint64_t seed = stats_now_ns(), start_ns;
+    double seconds;
+
+    while ((opt = getopt(argc, argv, "n:j:b:l:s:r:o:")) != -1) {
+        switch (opt) {
+        case 'n': programs = atol(optarg); break;
+        case 'j': jobs = atol(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'l': MAX_LEN = atoi(optarg); break;
+        case 's': seed = strtoull(optarg, NULL, 0); break;
+        case 'r': REF_SIM = optarg; break;
+        case 'o': OUT_DIR = optarg; break;
+        default:  usage(argv[0]);
+        }
+    }
+    if (jobs < 1 || batch < 1 || batch > FUZZ_MAX_BATCH || MAX_LEN < 1 ||
+        MAX_LEN > FUZZ_MAX_LEN - 8 || access(REF_SIM, X_OK) != 0)
+        usage(argv[0]);
+
+    /* workers run from their own temporary directories, so pin down the paths first */
+    REF_SIM = realpath(REF_SIM, NULL);
+    OUT_DIR = realpath(OUT_DIR, NULL);
+    if (OUT_DIR == NULL) {
+        perror("out_dir");
+        exit(1);
+    }
+
+    printf("Fuzzing %ld programs on %ld jobs, seed 0x%" PRIx64 "\n", programs, jobs, seed);
+    fflush(stdout);
+
+    start_ns = stats_now_ns();
+    for (j = 0; j < jobs; j++) {
+        long share = programs / jobs + (j < programs % jobs);
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            exit(fuzz_worker(seed + 0x9E3779B97F4A7C15ULL * (j + 1), share, batch) ? 1 : 0);
+        }
+        if (pid < 0) {
+            perror("fork");
+            exit(2);
+        }
+    }
+    for (j = 0; j < jobs; j++) {
+        int status;
+        if (wait(&status) <= 0)
+            continue;
+        /* workers exit with 1 on mismatches and 2 if they could not fuzz their share */
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 1)
+            found = 1;
+        else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            broken = 1;
+    }
+    seconds = (stats_now_ns() - start_ns) / 1e9;
+
+    printf("%ld programs in %.2f s (%.0f programs/s)%s\n", programs, seconds,
+           programs / seconds, broken ? ", a worker failed" :
+           found ? ", mismatches found" : ", no mismatches");
+    return broken ? 2 : found;
+}
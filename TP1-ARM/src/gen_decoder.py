@@ -0,0 +1,381 @@
+#!/usr/bin/env python3
+"""
+Generates decoder.h and decoder.c from isa.spec (see the format described
+at the top of that file).
+
+Decoding is a lookup on bits 31..21 that yields the short list of spec
+entries compatible with those bits (almost always one), followed by a
+single mask/compare per candidate, so its cost doesn't grow with the
+number of instructions in the spec.
+
+    ./gen_decoder.py [isa.spec] [output_dir]
+"""
+
+import os, re, shlex, sys
+
+PRIMARY_BITS = 11           # bits 31..21 index the primary table
+
+
+class Field:
+    def __init__(self, name, hi, lo, signed):
+        self.name, self.hi, self.lo, self.signed = name, hi, lo, signed
+
+    @property
+    def width(self):
+        return self.hi - self.lo + 1
+
+    def same_bits(self, other):
+        return (self.hi, self.lo, self.signed) == (other.hi, other.lo, other.signed)
+
+
+class Insn:
+    def __init__(self, name, pattern, fields, handler, syntax, line):
+        self.name, self.pattern, self.fields = name, pattern, fields
+        self.handler, self.syntax, self.line = handler, syntax, line
+        self.mask = int(''.join('0' if c == 'x' else '1' for c in pattern), 2)
+        self.value = int(pattern.replace('x', '0'), 2)
+
+    def matches_primary(self, index):
+        shift = 32 - PRIMARY_BITS
+        return ((index << shift) & self.mask) == (self.value & self.mask & ~((1 << shift) - 1))
+
+
+def fail(path, line, message):
+    sys.exit('%s:%d: %s' % (path, line, message))
+
+
+def parse_spec(path):
+    insns = []
+    for number, text in enumerate(open(path), 1):
+        text = text.strip()
+        if not text or text.startswith('#'):
+            continue
+        parts = shlex.split(text)
+        if len(parts) != 5:
+            fail(path, number, 'expected: NAME pattern fields handler "syntax"')
+        name, pattern, field_text, handler, syntax = parts
+        if not re.fullmatch(r'[01x]{32}', pattern):
+            fail(path, number, 'pattern must be 32 characters of 0, 1 or x')
+        fields = []
+        for spec in ([] if field_text == '-' else field_text.split(',')):
+            m = re.fullmatch(r'(\w+)=(\d+)(?::(\d+))?(s?)', spec)
+            if not m:
+                fail(path, number, 'bad field "%s"' % spec)
+            hi = int(m.group(2))
+            lo = int(m.group(3)) if m.group(3) else hi
+            if not 0 <= lo <= hi <= 31:
+                fail(path, number, 'bad bit range in "%s"' % spec)
+            fields.append(Field(m.group(1), hi, lo, m.group(4) == 's'))
+        insns.append(Insn(name, pattern, fields, handler, syntax, number))
+    return insns
+
+
+def check(path, insns):
+    fields = {}
+    for insn in insns:
+        for f in insn.fields:
+            if f.name in fields and not fields[f.name].same_bits(f):
+                fail(path, insn.line, 'field %s is defined with different bits elsewhere' % f.name)
+            fields.setdefault(f.name, f)
+    for i, a in enumerate(insns):
+        for b in insns[i + 1:]:
+            common = a.mask & b.mask
+            if (a.value & common) == (b.value & common):
+                fail(path, b.line, '%s overlaps %s' % (b.name, a.name))
+    return [fields[name] for name in sorted(fields)]
+
+
+def split_syntax(text):
+    """Split a template into literal strings and (field, modifier, nested) tuples."""
+    parts, i, literal = [], 0, ''
+    while i < len(text):
+        if text[i] != '{':
+            literal += text[i]
+            i += 1
+            continue
+        depth, j = 1, i + 1
+        while depth:
+            depth += {'{': 1, '}': -1}.get(text[j], 0)
+            j += 1
+        if literal:
+            parts.append(literal)
+            literal = ''
+        inner = text[i + 1:j - 1]
+        m = re.fullmatch(r'(\w+)\?(.*)', inner, re.S)
+        if m:
+            parts.append((m.group(1), '?', split_syntax(m.group(2))))
+        else:
+            name, _, modifier = inner.partition(':')
+            parts.append((name, modifier, None))
+        i = j
+    if literal:
+        parts.append(literal)
+    return parts
+
+
+def c_string(text):
+    return '"%s"' % text.replace('\\', '\\\\').replace('"', '\\"')
+
+
+def emit_syntax(parts, insn, indent):
+    known = {f.name for f in insn.fields}
+    lines = []
+    for part in parts:
+        if isinstance(part, str):
+            lines.append('%sp = isa_put(p, end, %s);' % (indent, c_string(part)))
+            continue
+        name, modifier, nested = part
+        if name not in known:
+            sys.exit('isa.spec:%d: syntax uses unknown field %s' % (insn.line, name))
+        value = 'f->%s' % name
+        if modifier == '?':
+            lines.append('%sif (%s) {' % (indent, value))
+            lines += emit_syntax(nested, insn, indent + '    ')
+            lines.append('%s}' % indent)
+        elif modifier == 'r':
+            lines.append('%sp = isa_put_reg(p, end, \'x\', %s);' % (indent, value))
+        elif modifier == 'w':
+            lines.append('%sp = isa_put_reg(p, end, \'w\', %s);' % (indent, value))
+        elif modifier == 's':
+            lines.append('%sp = isa_put_fmt(p, end, "%%" PRId64, (int64_t)%s);' % (indent, value))
+        elif modifier == 'b':
+            lines.append('%sp = isa_put_fmt(p, end, "0x%%" PRIx64, pc + (uint64_t)%s * 4);' % (indent, value))
+        elif modifier == 'c':
+            lines.append('%sp = isa_put(p, end, isa_cond_names[%s & 0xf]);' % (indent, value))
+        elif modifier.isdigit():
+            lines.append('%sp = isa_put_fmt(p, end, "%%" PRIu64, (uint64_t)%s * %s);' % (indent, value, modifier))
+        elif modifier == '':
+            lines.append('%sp = isa_put_fmt(p, end, "0x%%" PRIx64, (uint64_t)%s);' % (indent, value))
+        else:
+            sys.exit('isa.spec:%d: unknown syntax modifier :%s' % (insn.line, modifier))
+    return lines
+
+
+def extractor(f):
+    mask = (1 << f.width) - 1
+    if f.signed:
+        return ('static inline int64_t isa_field_%s(uint32_t raw)\n{\n'
+                '    int64_t v = (raw >> %d) & 0x%x;\n'
+                '    return (v ^ 0x%x) - 0x%x;\n}\n' % (f.name, f.lo, mask, 1 << (f.width - 1), 1 << (f.width - 1)))
+    return ('static inline uint32_t isa_field_%s(uint32_t raw)\n{\n'
+            '    return (raw >> %d) & 0x%x;\n}\n' % (f.name, f.lo, mask))
+
+
+HEADER = '''/* Generated by gen_decoder.py from %(spec)s -- do not edit. */
+
+#ifndef _SIM_DECODER_H_
+#define _SIM_DECODER_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+typedef enum {
+    ISA_UNKNOWN,
+%(ops)s
+    ISA_NUM_OPS
+} isa_op_t;
+
+/* Every field any instruction uses; isa_decode only fills the ones of the decoded op. */
+typedef struct {
+    isa_op_t op;
+    uint32_t raw;
+%(members)s
+} isa_fields_t;
+
+%(extractors)s
+isa_op_t    isa_decode(uint32_t raw, isa_fields_t *f);
+void        isa_execute(const isa_fields_t *f);
+const char *isa_name(isa_op_t op);
+int         isa_disassemble(uint32_t raw, uint64_t pc, char *buf, size_t size);
+
+/* Handlers, implemented in sim.c */
+%(handlers)s
+
+#endif
+'''
+
+SOURCE = '''/* Generated by gen_decoder.py from %(spec)s -- do not edit. */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include "decoder.h"
+
+typedef struct {
+    uint32_t mask, value;
+    isa_op_t op;
+} isa_pattern_t;
+
+typedef struct {
+    uint8_t first, count;
+} isa_slot_t;
+
+/* Candidates for each primary slot, stored back to back */
+static const isa_pattern_t isa_patterns[] = {
+%(patterns)s
+};
+
+/* Indexed by bits 31..21 */
+static const isa_slot_t isa_primary[%(primary_size)d] = {
+%(primary)s
+};
+
+static const char *const isa_names[ISA_NUM_OPS] = {
+    "UNKNOWN",
+%(names)s
+};
+
+static void (*const isa_handlers[ISA_NUM_OPS])(const isa_fields_t *) = {
+    NULL,
+%(handler_table)s
+};
+
+static const char *const isa_cond_names[16] = {
+    "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
+    "hi", "ls", "ge", "lt", "gt", "le", "al", "nv"
+};
+
+isa_op_t isa_decode(uint32_t raw, isa_fields_t *f)
+{
+    const isa_slot_t *slot = &isa_primary[raw >> %(primary_shift)d];
+    const isa_pattern_t *p = &isa_patterns[slot->first];
+    int n;
+
+    f->raw = raw;
+    f->op = ISA_UNKNOWN;
+    for (n = slot->count; n > 0; n--, p++) {
+        if ((raw & p->mask) == p->value) {
+            f->op = p->op;
+            break;
+        }
+    }
+
+    switch (f->op) {
+%(extract)s
+    default:
+        break;
+    }
+    return f->op;
+}
+
+void isa_execute(const isa_fields_t *f)
+{
+    isa_handlers[f->op](f);
+}
+
+const char *isa_name(isa_op_t op)
+{
+    return op < ISA_NUM_OPS ? isa_names[op] : "UNKNOWN";
+}
+
+static char *isa_put(char *p, char *end, const char *text)
+{
+    while (*text && p < end - 1)
+        *p++ = *text++;
+    *p = '\\0';
+    return p;
+}
+
+static char *isa_put_fmt(char *p, char *end, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(p, end - p, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return p;
+    return n < end - p ? p + n : end - 1;
+}
+
+static char *isa_put_reg(char *p, char *end, char kind, uint32_t reg)
+{
+    if (reg == 31)
+        return isa_put(p, end, kind == 'w' ? "wzr" : "xzr");
+    return isa_put_fmt(p, end, "%%c%%u", kind, reg);
+}
+
+int isa_disassemble(uint32_t raw, uint64_t pc, char *buf, size_t size)
+{
+    isa_fields_t fields, *f = &fields;
+    char *p = buf, *end = buf + size;
+
+    if (size == 0)
+        return 0;
+    *p = '\\0';
+
+    switch (isa_decode(raw, f)) {
+%(disassemble)s
+    default:
+        p = isa_put_fmt(p, end, ".word 0x%%08x", raw);
+        break;
+    }
+    return (int)(p - buf);
+}
+'''
+
+
+def generate(spec_path, out_dir):
+    insns = parse_spec(spec_path)
+    fields = check(spec_path, insns)
+    spec = os.path.basename(spec_path)
+
+    members = []
+    for f in fields:
+        members.append('    %s %s;' % ('int64_t ' if f.signed else 'uint32_t', f.name))
+
+    header = HEADER % dict(
+        spec=spec,
+        ops='\n'.join('    ISA_%s,' % i.name for i in insns),
+        members='\n'.join(members),
+        extractors='\n'.join(extractor(f) for f in fields),
+        handlers='\n'.join(sorted({'void %s(const isa_fields_t *f);' % i.handler for i in insns})),
+    )
+
+    # primary table: each slot points at the run of candidates compatible with it
+    groups, patterns, primary = {}, [], []
+    for index in range(1 << PRIMARY_BITS):
+        group = tuple(i for i, insn in enumerate(insns) if insn.matches_primary(index))
+        if group not in groups:
+            groups[group] = len(patterns)
+            patterns += [insns[i] for i in group]
+        primary.append((groups[group] if group else 0, len(group)))
+    if len(patterns) > 255 or max(c for _, c in primary) > 255:
+        sys.exit('%s: primary table overflow' % spec_path)
+
+    extract, disassemble = [], []
+    for insn in insns:
+        extract.append('    case ISA_%s:' % insn.name)
+        for f in insn.fields:
+            extract.append('        f->%s = isa_field_%s(raw);' % (f.name, f.name))
+        extract.append('        break;')
+        disassemble.append('    case ISA_%s:' % insn.name)
+        disassemble += emit_syntax(split_syntax(insn.syntax), insn, '        ')
+        disassemble.append('        break;')
+
+    rows = []
+    for start in range(0, len(primary), 8):
+        rows.append('    ' + ' '.join('{%3d, %d},' % slot for slot in primary[start:start + 8]))
+
+    source = SOURCE % dict(
+        spec=spec,
+        patterns='\n'.join('    { 0x%08x, 0x%08x, ISA_%s },' % (i.mask, i.value, i.name) for i in patterns),
+        primary_size=1 << PRIMARY_BITS,
+        primary='\n'.join(rows),
+        primary_shift=32 - PRIMARY_BITS,
+        names='\n'.join('    "%s",' % i.name for i in insns),
+        handler_table='\n'.join('    %s,' % i.handler for i in insns),
+        extract='\n'.join(extract),
+        disassemble='\n'.join(disassemble),
+    )
+
+    for name, text in (('decoder.h', header), ('decoder.c', source)):
+        with open(os.path.join(out_dir, name), 'w') as f:
+            f.write(text)
+
+
+if __name__ == '__main__':
+    here = os.path.dirname(os.path.abspath(__file__))
+    spec_path = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, 'isa.spec')
+    out_dir = sys.argv[2] if len(sys.argv) > 2 else os.path.dirname(os.path.abspath(spec_path))
+    generate(spec_path, out_dir)
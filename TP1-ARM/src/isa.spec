@@ -0,0 +1,55 @@
+# Instruction set implemented by the simulator.
+#
+# gen_decoder.py turns this file into decoder.h/decoder.c, which hold the
+# decode tables, the field extractors and the disassembler. The executor
+# (sim.c) and the disassembler both go through isa_decode().
+#
+# One instruction per line (lines starting with # are comments):
+#
+#   NAME  pattern  fields  handler  "disassembly"
+#
+# pattern   32 characters for bits 31..0: 0/1 must match, x is free.
+# fields    name=hi:lo (or name=bit); a trailing s sign-extends the field.
+#           Fields are comma separated, - for none.
+# handler   function in sim.c called as handler(&fields).
+# syntax    disassembly template; {f} prints a field in hex, {f:r} as an
+#           X register, {f:w} as a W register, {f:s} signed, {f:N} as
+#           field * N in decimal, {f:b} as a PC-relative branch target
+#           (field * 4), {f:c} as a condition code and {f?text} prints
+#           text (which may hold fields itself) only when f is non-zero.
+
+ADD_IMM   100100010xxxxxxxxxxxxxxxxxxxxxxx  sh=22,imm12=21:10,rn=9:5,rd=4:0     exec_add_imm   "add {rd:r}, {rn:r}, #{imm12}{sh?, lsl #12}"
+ADDS_IMM  101100010xxxxxxxxxxxxxxxxxxxxxxx  sh=22,imm12=21:10,rn=9:5,rd=4:0     exec_adds_imm  "adds {rd:r}, {rn:r}, #{imm12}{sh?, lsl #12}"
+SUBS_IMM  111100010xxxxxxxxxxxxxxxxxxxxxxx  sh=22,imm12=21:10,rn=9:5,rd=4:0     exec_subs_imm  "subs {rd:r}, {rn:r}, #{imm12}{sh?, lsl #12}"
+
+# Register forms: shifted register with shift=00 (bit 21 = 0, what the
+# assembler emits for "adds Xd, Xn, Xm") and extended register (bit 21 = 1).
+# Shift, extend and amount are ignored.
+ADD_REG   1000101100xxxxxxxxxxxxxxxxxxxxxx  rm=20:16,rn=9:5,rd=4:0              exec_add_reg   "add {rd:r}, {rn:r}, {rm:r}"
+ADDS_REG  1010101100xxxxxxxxxxxxxxxxxxxxxx  rm=20:16,rn=9:5,rd=4:0              exec_adds_reg  "adds {rd:r}, {rn:r}, {rm:r}"
+SUBS_REG  1110101100xxxxxxxxxxxxxxxxxxxxxx  rm=20:16,rn=9:5,rd=4:0              exec_subs_reg  "subs {rd:r}, {rn:r}, {rm:r}"
+
+ANDS      11101010000xxxxxxxxxxxxxxxxxxxxx  rm=20:16,rn=9:5,rd=4:0              exec_ands      "ands {rd:r}, {rn:r}, {rm:r}"
+ORR       10101010000xxxxxxxxxxxxxxxxxxxxx  rm=20:16,rn=9:5,rd=4:0              exec_orr       "orr {rd:r}, {rn:r}, {rm:r}"
+EOR       11001010000xxxxxxxxxxxxxxxxxxxxx  rm=20:16,rn=9:5,rd=4:0              exec_eor       "eor {rd:r}, {rn:r}, {rm:r}"
+
+# LSL and LSR (immediate) are aliases of UBFM
+UBFM      1101001101xxxxxxxxxxxxxxxxxxxxxx  immr=21:16,imms=15:10,rn=9:5,rd=4:0 exec_ubfm      "ubfm {rd:r}, {rn:r}, #{immr}, #{imms}"
+MOVZ      110100101xxxxxxxxxxxxxxxxxxxxxxx  hw=22:21,imm16=20:5,rd=4:0          exec_movz      "movz {rd:r}, #{imm16}{hw?, lsl #{hw:16}}"
+# MUL is MADD with Ra = XZR
+MADD      10011011000xxxxx0xxxxxxxxxxxxxxx  rm=20:16,ra=14:10,rn=9:5,rd=4:0     exec_madd      "madd {rd:r}, {rn:r}, {rm:r}, {ra:r}"
+
+STUR      11111000000xxxxxxxxx00xxxxxxxxxx  imm9=20:12s,rn=9:5,rt=4:0           exec_stur      "stur {rt:r}, [{rn:r}, #{imm9:s}]"
+LDUR      11111000010xxxxxxxxx00xxxxxxxxxx  imm9=20:12s,rn=9:5,rt=4:0           exec_ldur      "ldur {rt:r}, [{rn:r}, #{imm9:s}]"
+STURH     01111000000xxxxxxxxx00xxxxxxxxxx  imm9=20:12s,rn=9:5,rt=4:0           exec_sturh     "sturh {rt:w}, [{rn:r}, #{imm9:s}]"
+LDURH     01111000010xxxxxxxxx00xxxxxxxxxx  imm9=20:12s,rn=9:5,rt=4:0           exec_ldurh     "ldurh {rt:w}, [{rn:r}, #{imm9:s}]"
+STURB     00111000000xxxxxxxxx00xxxxxxxxxx  imm9=20:12s,rn=9:5,rt=4:0           exec_sturb     "sturb {rt:w}, [{rn:r}, #{imm9:s}]"
+LDURB     00111000010xxxxxxxxx00xxxxxxxxxx  imm9=20:12s,rn=9:5,rt=4:0           exec_ldurb     "ldurb {rt:w}, [{rn:r}, #{imm9:s}]"
+
+B         000101xxxxxxxxxxxxxxxxxxxxxxxxxx  imm26=25:0s                         exec_b         "b {imm26:b}"
+BR        1101011000011111000000xxxxx00000  rn=9:5                              exec_br        "br {rn:r}"
+BCOND     01010100xxxxxxxxxxxxxxxxxxx0xxxx  imm19=23:5s,cond=3:0                exec_bcond     "b.{cond:c} {imm19:b}"
+CBZ       10110100xxxxxxxxxxxxxxxxxxxxxxxx  imm19=23:5s,rt=4:0                  exec_cbz       "cbz {rt:r}, {imm19:b}"
+CBNZ      10110101xxxxxxxxxxxxxxxxxxxxxxxx  imm19=23:5s,rt=4:0                  exec_cbnz      "cbnz {rt:r}, {imm19:b}"
+
+HLT       11010100010xxxxxxxxxxxxxxxx00000  imm16=20:5                          exec_hlt       "hlt #{imm16}"
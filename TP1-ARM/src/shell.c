@@ -26,20 +26,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <inttypes.h>
 #include "shell.h"
+#include "undo.h"
+#include "stats.h"
+#include "decoder.h"
+#include "snap.h"
 
 /***************************************************************/
 /* Main memory.                                                */
 /***************************************************************/
 
-#define MEM_DATA_START  0x10000000
-#define MEM_DATA_SIZE   0x00100000
-#define MEM_TEXT_START  0x00400000
-#define MEM_TEXT_SIZE   0x00100000
-#define MEM_STACK_START 0xfffffffc
-#define MEM_STACK_SIZE  0x00100000
-
 typedef struct {
     uint64_t start, size;
     uint8_t *mem;
@@ -60,7 +58,14 @@ mem_region_t MEM_REGIONS[] = {
 
 CPU_State CURRENT_STATE, NEXT_STATE;
 int RUN_BIT;	/* run bit */
-int INSTRUCTION_COUNT;
+uint64_t INSTRUCTION_COUNT;
+
+/* --stats-json destination, written when the simulator exits */
+static char *STATS_JSON_FILENAME;
+
+/* set by --undo to keep the reverse execution log; off by default, since
+   logging every instruction runs programs about half as fast */
+static int UNDO_ENABLED = FALSE;
 
 
 /***************************************************************/
@@ -104,6 +109,10 @@ void mem_write_32(uint64_t address, uint32_t value)
                 address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
             uint32_t offset = address - MEM_REGIONS[i].start;
 
+            if (UNDO_RECORDING)
+                undo_record_mem(address, mem_read_32(address));
+            snap_touch(i, offset);
+
             MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
             MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
             MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
@@ -124,8 +133,15 @@ void help() {
   printf("go               -  run program to completion         \n");
   printf("run n            -  execute program for n instructions\n");
   printf("mdump low high   -  dump memory from low to high      \n");
+  printf("disasm low high  -  disassemble memory from low to high\n");
+  printf("snap name        -  take a memory snapshot called name\n");
+  printf("mdiff name [other] - list the words that changed since snapshot\n");
+  printf("                    name (or between name and other)  \n");
   printf("rdump            -  dump the register & bus values    \n");
+  printf("stats            -  dump the simulator counters       \n");
   printf("input reg_no reg_value - set GPR reg_no to reg_value  \n");
+  printf("rstep n          -  undo the last n instructions (--undo)\n");
+  printf("rcontinue        -  undo back to the oldest logged state (--undo)\n");
   printf("?                -  display this help menu            \n");
   printf("quit             -  exit the program                  \n\n");
 }
@@ -139,9 +155,14 @@ void help() {
 /***************************************************************/
 void cycle() {                                                
 
+  if (UNDO_ENABLED)
+    undo_begin_step();
   process_instruction();
+  if (UNDO_ENABLED)
+    undo_end_step();
   CURRENT_STATE = NEXT_STATE;
   INSTRUCTION_COUNT++;
+  SIM_STATS.instructions++;
 }
 
 /***************************************************************/
@@ -151,15 +172,16 @@ void cycle() {
 /* Purpose   : Simulate ARM for n cycles                       */
 /*                                                             */
 /***************************************************************/
-void run(int num_cycles) {                                      
-  int i;
+void run(uint64_t num_cycles) {                                 
+  uint64_t i, start_ns;
 
   if (RUN_BIT == FALSE) {
     printf("Can't simulate, Simulator is halted\n\n");
     return;
   }
 
-  printf("Simulating for %d cycles...\n\n", num_cycles);
+  printf("Simulating for %" PRIu64 " cycles...\n\n", num_cycles);
+  start_ns = stats_now_ns();
   for (i = 0; i < num_cycles; i++) {
     if (RUN_BIT == FALSE) {
 	    printf("Simulator halted\n\n");
@@ -167,6 +189,48 @@ void run(int num_cycles) {
     }
     cycle();
   }
+  SIM_STATS.host_ns += stats_now_ns() - start_ns;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : rstep n                                         */
+/*                                                             */
+/* Purpose   : Undo the last n instructions                    */
+/*                                                             */
+/***************************************************************/
+void rstep(uint64_t num_steps) {
+  uint64_t undone;
+
+  if (UNDO_ENABLED == FALSE) {
+    printf("Can't step back, reverse execution is off (start the simulator with --undo)\n\n");
+    return;
+  }
+
+  printf("Stepping back %" PRIu64 " instructions...\n\n", num_steps);
+  undone = undo_step_back(num_steps);
+  if (undone < num_steps)
+    printf("Reverse execution history exhausted after %" PRIu64 " instructions\n\n", undone);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : rcontinue                                       */
+/*                                                             */
+/* Purpose   : Undo every logged instruction                   */
+/*                                                             */
+/***************************************************************/
+void rcontinue() {
+  uint64_t undone;
+
+  if (UNDO_ENABLED == FALSE) {
+    printf("Can't step back, reverse execution is off (start the simulator with --undo)\n\n");
+    return;
+  }
+
+  printf("Reversing...\n\n");
+  undone = undo_step_back(undo_available());
+  printf("Reversed %" PRIu64 " instructions\n\n", undone);
 }
 
 /***************************************************************/ 
@@ -194,6 +258,33 @@ void mdump(FILE * dumpsim_file, int start, int stop) {
   fprintf(dumpsim_file, "\n");
 }
 
+/***************************************************************/
+/*                                                             */
+/* Procedure : disasm                                          */
+/*                                                             */
+/* Purpose   : Disassemble a word-aligned region of memory to  */
+/*             the output file, using the executor's decoder.  */
+/*                                                             */
+/***************************************************************/
+void disasm(FILE * dumpsim_file, int start, int stop) {
+  int address;
+  uint32_t word;
+  char text[64];
+
+  printf("\nDisassembly [0x%08x..0x%08x] :\n", start, stop);
+  printf("-------------------------------------\n");
+  fprintf(dumpsim_file, "\nDisassembly [0x%08x..0x%08x] :\n", start, stop);
+  fprintf(dumpsim_file, "-------------------------------------\n");
+  for (address = start; address <= stop; address += 4) {
+    word = mem_read_32(address);
+    isa_disassemble(word, address, text, sizeof(text));
+    printf("  0x%08x : %08x  %s\n", address, word, text);
+    fprintf(dumpsim_file, "  0x%08x : %08x  %s\n", address, word, text);
+  }
+  printf("\n");
+  fprintf(dumpsim_file, "\n");
+}
+
 /***************************************************************/
 /*                                                             */
 /* Procedure : rdump                                           */
@@ -207,7 +298,7 @@ void rdump(FILE * dumpsim_file) {
 
   printf("\nCurrent register/bus values :\n");
   printf("-------------------------------------\n");
-  printf("Instruction Count : %u\n", INSTRUCTION_COUNT);
+  printf("Instruction Count : %" PRIu64 "\n", INSTRUCTION_COUNT);
   printf("PC                : 0x%" PRIx64 "\n", CURRENT_STATE.PC);
   printf("Registers:\n");
   for (k = 0; k < ARM_REGS; k++)
@@ -219,7 +310,7 @@ void rdump(FILE * dumpsim_file) {
   /* dump the state information into the dumpsim file */
   fprintf(dumpsim_file, "\nCurrent register/bus values :\n");
   fprintf(dumpsim_file, "-------------------------------------\n");
-  fprintf(dumpsim_file, "Instruction Count : %u\n", INSTRUCTION_COUNT);
+  fprintf(dumpsim_file, "Instruction Count : %" PRIu64 "\n", INSTRUCTION_COUNT);
   fprintf(dumpsim_file, "PC                : 0x%" PRIx64 "\n", CURRENT_STATE.PC);
   fprintf(dumpsim_file, "Registers:\n");
   for (k = 0; k < ARM_REGS; k++)
@@ -236,22 +327,84 @@ void rdump(FILE * dumpsim_file) {
 /*                                                             */
 /***************************************************************/
 void go(FILE * dumpsim_file) {                                                     
+  uint64_t start_ns;
+
   if (RUN_BIT == FALSE) {
     printf("Can't simulate, Simulator is halted\n\n");
     return;
   }
 
   printf("Simulating...\n\n");
+  start_ns = stats_now_ns();
   while (RUN_BIT) {
     cycle();
     //printf("Going\n");
     //rdump(dumpsim_file);
     //mdump(dumpsim_file, MEM_DATA_START, MEM_DATA_START+0x100);
   }
+  SIM_STATS.host_ns += stats_now_ns() - start_ns;
   printf("Simulator halted\n\n");
 }
 
 
+/***************************************************************/
+/*                                                             */
+/* Procedure : stats                                           */
+/*                                                             */
+/* Purpose   : Dump the simulator counters to the screen and   */
+/*             the output file.                                */
+/*                                                             */
+/***************************************************************/
+void stats(FILE * dumpsim_file) {
+  stats_print(stdout);
+  stats_print(dumpsim_file);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : snap                                            */
+/*                                                             */
+/* Purpose   : Read a name and snapshot memory under it.       */
+/*                                                             */
+/***************************************************************/
+void snap() {
+  char name[SNAP_NAME_LEN];
+  int copied;
+
+  if (scanf("%31s", name) != 1)
+    return;
+
+  copied = snap_take(name);
+  if (copied < 0)
+    printf("Too many snapshots, reuse a name to replace one\n\n");
+  else
+    printf("Snapshot %s taken (%d pages copied)\n\n", name, copied);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : mdiff                                           */
+/*                                                             */
+/* Purpose   : Read one or two snapshot names from the rest of */
+/*             the line and dump the words that differ to the  */
+/*             output file.                                    */
+/*                                                             */
+/***************************************************************/
+void mdiff(FILE * dumpsim_file) {
+  char line[2 * SNAP_NAME_LEN + 8], name[SNAP_NAME_LEN], other[SNAP_NAME_LEN];
+  int n;
+
+  if (fgets(line, sizeof(line), stdin) == NULL)
+    return;
+  n = sscanf(line, "%31s %31s", name, other);
+  if (n < 1) {
+    printf("Usage: mdiff name [other]\n\n");
+    return;
+  }
+  if (snap_diff(dumpsim_file, name, n == 2 ? other : NULL) < 0)
+    printf("Unknown snapshot\n\n");
+}
+
 /***************************************************************/
 /*                                                             */
 /* Procedure : get_command                                     */
@@ -261,9 +414,10 @@ void go(FILE * dumpsim_file) {
 /***************************************************************/
 void get_command(FILE * dumpsim_file) {                         
   char buffer[20];
-  int start, stop, cycles;
+  int start, stop;
   int register_no;
   int64_t register_value;
+  uint64_t cycles, steps;
 
   printf("ARM-SIM> ");
 
@@ -280,12 +434,24 @@ void get_command(FILE * dumpsim_file) {
 
   case 'M':
   case 'm':
+    if (strcasecmp(buffer, "mdiff") == 0) {
+      mdiff(dumpsim_file);
+      break;
+    }
     if (scanf("%i %i", &start, &stop) != 2)
         break;
 
     mdump(dumpsim_file, start, stop);
     break;
 
+  case 'D':
+  case 'd':
+    if (scanf("%i %i", &start, &stop) != 2)
+        break;
+
+    disasm(dumpsim_file, start, stop);
+    break;
+
   case '?':
     help();
     break;
@@ -299,18 +465,36 @@ void get_command(FILE * dumpsim_file) {
   case 'r':
     if (buffer[1] == 'd' || buffer[1] == 'D')
 	    rdump(dumpsim_file);
+    else if (strcasecmp(buffer, "rstep") == 0) {
+	    if (scanf("%" SCNu64, &steps) != 1) break;
+	    rstep(steps);
+    }
+    else if (strcasecmp(buffer, "rcontinue") == 0)
+	    rcontinue();
     else {
-	    if (scanf("%d", &cycles) != 1) break;
+	    if (scanf("%" SCNu64, &cycles) != 1) break;
 	    run(cycles);
     }
     break;
 
+  case 'S':
+  case 's':
+    if (strcasecmp(buffer, "stats") == 0)
+      stats(dumpsim_file);
+    else if (strcasecmp(buffer, "snap") == 0)
+      snap();
+    else
+      printf("Invalid Command\n");
+    break;
+
   case 'I':
   case 'i':
    if (scanf("%i %" PRIx64, &register_no, &register_value) != 2)
       break;
    CURRENT_STATE.REGS[register_no] = register_value;
    NEXT_STATE.REGS[register_no] = register_value;
+   /* the log can't undo a change made by hand */
+   undo_reset();
    break;
 
   default:
@@ -332,6 +516,7 @@ void init_memory() {
         // Extra 3 bytes to prevent buffer overflow on unaligned access.
         MEM_REGIONS[i].mem = malloc(MEM_REGIONS[i].size + 3);
         memset(MEM_REGIONS[i].mem, 0, MEM_REGIONS[i].size);
+        snap_add_region(i, MEM_REGIONS[i].start, MEM_REGIONS[i].size, MEM_REGIONS[i].mem);
     }
 }
 
@@ -379,37 +564,76 @@ void load_program(char *program_filename) {
 /*             and set up initial state of the machine.     */
 /*                                                          */
 /************************************************************/
-void initialize(char *program_filename, int num_prog_files) { 
+void initialize(char *program_filenames[], int num_prog_files) { 
   int i;
 
   init_memory();
-  for ( i = 0; i < num_prog_files; i++ ) {
-    load_program(program_filename);
-    while(*program_filename++ != '\0');
-  }
+  for ( i = 0; i < num_prog_files; i++ )
+    load_program(program_filenames[i]);
   NEXT_STATE = CURRENT_STATE;
     
   RUN_BIT = TRUE;
 }
 
+/***************************************************************/
+/*                                                             */
+/* Procedure : write_stats_json                                */
+/*                                                             */
+/* Purpose   : atexit hook for --stats-json                    */
+/*                                                             */
+/***************************************************************/
+void write_stats_json() {
+  FILE * json_file;
+
+  if (STATS_JSON_FILENAME == NULL)
+    return;
+  if (strcmp(STATS_JSON_FILENAME, "-") == 0) {
+    stats_write_json(stdout);
+    return;
+  }
+  if ((json_file = fopen(STATS_JSON_FILENAME, "w")) == NULL) {
+    printf("Error: Can't open stats file %s\n", STATS_JSON_FILENAME);
+    return;
+  }
+  stats_write_json(json_file);
+  fclose(json_file);
+}
+
 /***************************************************************/
 /*                                                             */
 /* Procedure : main                                            */
 /*                                                             */
 /***************************************************************/
+#ifndef SIM_NO_MAIN
 int main(int argc, char *argv[]) {                              
   FILE * dumpsim_file;
+  int i, num_prog_files = 0;
+
+  /* Options may appear anywhere; program files are packed to the front of argv */
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc)
+      STATS_JSON_FILENAME = argv[++i];
+    else if (strcmp(argv[i], "--undo") == 0)
+      UNDO_ENABLED = TRUE;
+    else if (strcmp(argv[i], "--no-undo") == 0)
+      UNDO_ENABLED = FALSE;
+    else
+      argv[1 + num_prog_files++] = argv[i];
+  }
 
   /* Error Checking */
-  if (argc < 2) {
-    printf("Error: usage: %s <program_file_1> <program_file_2> ...\n",
+  if (num_prog_files < 1) {
+    printf("Error: usage: %s [--stats-json <file>] [--undo | --no-undo] <program_file_1> <program_file_2> ...\n",
            argv[0]);
     exit(1);
   }
 
   printf("ARM Simulator\n\n");
 
-  initialize(argv[1], argc - 1);
+  initialize(&argv[1], num_prog_files);
+
+  if (STATS_JSON_FILENAME != NULL)
+    atexit(write_stats_json);
 
   if ( (dumpsim_file = fopen( "dumpsim", "w" )) == NULL ) {
     printf("Error: Can't open dumpsim file\n");
@@ -419,3 +643,4 @@ int main(int argc, char *argv[]) {
   while (1)
     get_command(dumpsim_file);
 }
+#endif
@@ -21,6 +21,14 @@
 
 #define ARM_REGS 32
 
+/* Memory layout */
+#define MEM_DATA_START  0x10000000
+#define MEM_DATA_SIZE   0x00100000
+#define MEM_TEXT_START  0x00400000
+#define MEM_TEXT_SIZE   0x00100000
+#define MEM_STACK_START 0xfffffffc
+#define MEM_STACK_SIZE  0x00100000
+
 typedef struct CPU_State_Struct {
   uint64_t PC;		          /* program counter */
   int64_t REGS[ARM_REGS];   /* register file. */
@@ -33,10 +41,14 @@ typedef struct CPU_State_Struct {
 extern CPU_State CURRENT_STATE, NEXT_STATE;
 
 extern int RUN_BIT;	/* run bit */
+extern uint64_t INSTRUCTION_COUNT;
 
 uint32_t mem_read_32(uint64_t address);
 void     mem_write_32(uint64_t address, uint32_t value);
 
+void init_memory();
+void cycle();
+
 /* YOU IMPLEMENT THIS FUNCTION */
 void process_instruction();
 
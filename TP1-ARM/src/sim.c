@@ -1,11 +1,199 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include "shell.h"
+#include "stats.h"
+#include "decoder.h"
+
+/* X31 is XZR for every instruction we implement: reads give 0, writes are dropped. */
+static int64_t read_reg(int r)
+{
+    return r == 31 ? 0 : CURRENT_STATE.REGS[r];
+}
+
+static void write_reg(int r, int64_t value)
+{
+    if (r != 31)
+        NEXT_STATE.REGS[r] = value;
+}
+
+/* Only N and Z are modelled, C and V are always 0. */
+static void set_flags(int64_t result)
+{
+    NEXT_STATE.FLAG_N = result < 0;
+    NEXT_STATE.FLAG_Z = result == 0;
+    SIM_STATS.flag_writes++;
+}
+
+static void branch_if(int taken, int64_t offset)
+{
+    if (taken) {
+        NEXT_STATE.PC = CURRENT_STATE.PC + offset;
+        SIM_STATS.branches_taken++;
+    } else {
+        SIM_STATS.branches_not_taken++;
+    }
+}
+
+static int condition_holds(int cond)
+{
+    int n = CURRENT_STATE.FLAG_N, z = CURRENT_STATE.FLAG_Z;
+    int result;
+
+    switch (cond >> 1) {
+    case 0: result = z;           break;  /* EQ / NE */
+    case 1: result = 0;           break;  /* CS / CC (C = 0) */
+    case 2: result = n;           break;  /* MI / PL */
+    case 3: result = 0;           break;  /* VS / VC (V = 0) */
+    case 4: result = 0;           break;  /* HI / LS (C = 0) */
+    case 5: result = n == 0;      break;  /* GE / LT (V = 0) */
+    case 6: result = !z && !n;    break;  /* GT / LE (V = 0) */
+    default: result = 1;          break;  /* AL */
+    }
+    if ((cond & 1) && cond != 0xf)
+        result = !result;
+    return result;
+}
+
+/***************************************************************/
+/* Memory helpers. The shell only gives us aligned-or-not 32   */
+/* bit accesses, so wider and narrower ones are built on them. */
+/***************************************************************/
+
+static uint64_t load_64(uint64_t address)
+{
+    return (uint64_t)mem_read_32(address) |
+           ((uint64_t)mem_read_32(address + 4) << 32);
+}
+
+static void store_64(uint64_t address, uint64_t value)
+{
+    mem_write_32(address, (uint32_t)value);
+    mem_write_32(address + 4, (uint32_t)(value >> 32));
+}
+
+static void store_partial(uint64_t address, uint32_t value, int bytes)
+{
+    uint32_t mask = bytes == 1 ? 0xff : 0xffff;
+    uint32_t word = mem_read_32(address);
+
+    mem_write_32(address, (word & ~mask) | (value & mask));
+}
+
+/***************************************************************/
+/* Execute stage. One handler per isa.spec entry; isa_decode() */
+/* has already extracted (and sign extended) the fields.       */
+/***************************************************************/
+
+static void add_sub(const isa_fields_t *f, uint64_t operand, int subtract, int set)
+{
+    uint64_t a = read_reg(f->rn);
+    int64_t result = (int64_t)(subtract ? a - operand : a + operand);
+
+    write_reg(f->rd, result);
+    if (set)
+        set_flags(result);
+}
+
+void exec_add_imm(const isa_fields_t *f)  { add_sub(f, (uint64_t)f->imm12 << (12 * f->sh), 0, 0); }
+void exec_adds_imm(const isa_fields_t *f) { add_sub(f, (uint64_t)f->imm12 << (12 * f->sh), 0, 1); }
+void exec_subs_imm(const isa_fields_t *f) { add_sub(f, (uint64_t)f->imm12 << (12 * f->sh), 1, 1); }
+void exec_add_reg(const isa_fields_t *f)  { add_sub(f, read_reg(f->rm), 0, 0); }
+void exec_adds_reg(const isa_fields_t *f) { add_sub(f, read_reg(f->rm), 0, 1); }
+void exec_subs_reg(const isa_fields_t *f) { add_sub(f, read_reg(f->rm), 1, 1); }
+
+void exec_ands(const isa_fields_t *f)
+{
+    int64_t result = read_reg(f->rn) & read_reg(f->rm);
+
+    write_reg(f->rd, result);
+    set_flags(result);
+}
+
+void exec_orr(const isa_fields_t *f) { write_reg(f->rd, read_reg(f->rn) | read_reg(f->rm)); }
+void exec_eor(const isa_fields_t *f) { write_reg(f->rd, read_reg(f->rn) ^ read_reg(f->rm)); }
+
+void exec_ubfm(const isa_fields_t *f)
+{
+    uint64_t value = read_reg(f->rn);
+
+    if (f->imms == 63)
+        write_reg(f->rd, value >> f->immr);                      /* LSR */
+    else if (f->imms + 1 == f->immr)
+        write_reg(f->rd, value << (63 - f->imms));               /* LSL */
+    else
+        printf("Unsupported bitfield move 0x%08x\n", f->raw);
+}
+
+void exec_movz(const isa_fields_t *f)
+{
+    write_reg(f->rd, (int64_t)((uint64_t)f->imm16 << (16 * f->hw)));
+}
+
+void exec_madd(const isa_fields_t *f)
+{
+    write_reg(f->rd, (int64_t)((uint64_t)read_reg(f->ra) +
+                               (uint64_t)read_reg(f->rn) * (uint64_t)read_reg(f->rm)));
+}
+
+static void load(const isa_fields_t *f, int bytes)
+{
+    uint64_t address = read_reg(f->rn) + f->imm9;
+    uint64_t value = bytes == 8 ? load_64(address) : mem_read_32(address);
+
+    if (bytes < 4)
+        value &= bytes == 1 ? 0xff : 0xffff;
+    write_reg(f->rt, value);
+    SIM_STATS.loads++;
+}
+
+static void store(const isa_fields_t *f, int bytes)
+{
+    uint64_t address = read_reg(f->rn) + f->imm9;
+
+    if (bytes == 8)
+        store_64(address, read_reg(f->rt));
+    else
+        store_partial(address, (uint32_t)read_reg(f->rt), bytes);
+    SIM_STATS.stores++;
+}
+
+void exec_stur(const isa_fields_t *f)  { store(f, 8); }
+void exec_ldur(const isa_fields_t *f)  { load(f, 8); }
+void exec_sturh(const isa_fields_t *f) { store(f, 2); }
+void exec_ldurh(const isa_fields_t *f) { load(f, 2); }
+void exec_sturb(const isa_fields_t *f) { store(f, 1); }
+void exec_ldurb(const isa_fields_t *f) { load(f, 1); }
+
+void exec_b(const isa_fields_t *f)     { branch_if(TRUE, f->imm26 * 4); }
+void exec_bcond(const isa_fields_t *f) { branch_if(condition_holds(f->cond), f->imm19 * 4); }
+void exec_cbz(const isa_fields_t *f)   { branch_if(read_reg(f->rt) == 0, f->imm19 * 4); }
+void exec_cbnz(const isa_fields_t *f)  { branch_if(read_reg(f->rt) != 0, f->imm19 * 4); }
+
+void exec_br(const isa_fields_t *f)
+{
+    NEXT_STATE.PC = read_reg(f->rn);
+    SIM_STATS.branches_taken++;
+}
+
+void exec_hlt(const isa_fields_t *f)
+{
+    RUN_BIT = FALSE;
+}
 
 void process_instruction()
 {
     /* execute one instruction here. You should use CURRENT_STATE and modify
      * values in NEXT_STATE. You can call mem_read_32() and mem_write_32() to
-     * access memory. 
+     * access memory.
      * */
+    isa_fields_t f;
+
+    NEXT_STATE.PC = CURRENT_STATE.PC + 4;
+    if (isa_decode(mem_read_32(CURRENT_STATE.PC), &f) == ISA_UNKNOWN) {
+        printf("Unknown instruction 0x%08x at PC 0x%" PRIx64 "\n", f.raw, CURRENT_STATE.PC);
+        RUN_BIT = FALSE;
+        return;
+    }
+    isa_execute(&f);
 }
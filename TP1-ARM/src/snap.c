@@ -0,0 +1,282 @@
+/***************************************************************/
+/*                                                             */
+/*   ARM Instruction Level Simulator                           */
+/*                                                             */
+/*   Memory snapshots used by the snap and mdiff commands      */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shell.h"
+#include "snap.h"
+
+/* A page image, shared by every snapshot in which the page looked the same */
+typedef struct {
+    int     refs;
+    uint8_t data[SNAP_PAGE_SIZE];
+} snap_page_t;
+
+typedef struct {
+    uint64_t  start, size;
+    uint8_t  *mem;
+    uint32_t  num_pages;
+    snap_page_t **latest;       /* newest image of each page, NULL if never written */
+    uint32_t *latest_epoch;     /* epoch that image was captured in */
+} snap_region_t;
+
+typedef struct {
+    char      name[SNAP_NAME_LEN];
+    uint32_t  epoch;
+    snap_page_t **pages[SNAP_MAX_REGIONS];
+} snapshot_t;
+
+uint32_t  SNAP_EPOCH = 1;
+uint32_t *SNAP_PAGE_EPOCH[SNAP_MAX_REGIONS];
+
+static snap_region_t regions[SNAP_MAX_REGIONS];
+static int num_regions;
+static snapshot_t *snapshots[SNAP_MAX];
+
+static const uint8_t zero_page[SNAP_PAGE_SIZE];
+
+static void page_release(snap_page_t *page)
+{
+    if (page && --page->refs == 0)
+        free(page);
+}
+
+static const uint8_t *page_data(const snap_page_t *page)
+{
+    return page ? page->data : zero_page;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : snap_add_region                                 */
+/*                                                             */
+/* Purpose   : Start tracking a memory region. Called once per */
+/*             region by init_memory.                          */
+/*                                                             */
+/***************************************************************/
+void snap_add_region(int region, uint64_t start, uint64_t size, uint8_t *mem)
+{
+    snap_region_t *r = &regions[region];
+
+    r->start = start;
+    r->size = size;
+    r->mem = mem;
+    /* one spare page for the tail of an unaligned write at the end */
+    r->num_pages = (size + SNAP_PAGE_SIZE - 1) / SNAP_PAGE_SIZE + 1;
+    r->latest = calloc(r->num_pages, sizeof(*r->latest));
+    r->latest_epoch = calloc(r->num_pages, sizeof(*r->latest_epoch));
+    SNAP_PAGE_EPOCH[region] = calloc(r->num_pages, sizeof(uint32_t));
+    if (region >= num_regions)
+        num_regions = region + 1;
+}
+
+static snapshot_t *find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < SNAP_MAX; i++)
+        if (snapshots[i] && strcmp(snapshots[i]->name, name) == 0)
+            return snapshots[i];
+    return NULL;
+}
+
+static void drop(snapshot_t *snap)
+{
+    int i;
+    uint32_t p;
+
+    for (i = 0; i < num_regions; i++) {
+        for (p = 0; p < regions[i].num_pages; p++)
+            page_release(snap->pages[i][p]);
+        free(snap->pages[i]);
+    }
+    free(snap);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : snap_take                                       */
+/*                                                             */
+/* Purpose   : Capture memory under name, replacing a previous */
+/*             snapshot with the same name. Only pages written */
+/*             since the last capture are copied. Returns the  */
+/*             number of pages copied, or -1 if all snapshot   */
+/*             slots are in use.                               */
+/*                                                             */
+/***************************************************************/
+int snap_take(const char *name)
+{
+    snapshot_t *snap = calloc(1, sizeof(*snap));
+    int i, slot = -1, copied = 0;
+    uint32_t p;
+
+    for (i = 0; i < SNAP_MAX; i++) {
+        if (snapshots[i] && strcmp(snapshots[i]->name, name) == 0) {
+            slot = i;
+            break;
+        }
+        if (!snapshots[i] && slot < 0)
+            slot = i;
+    }
+    if (slot < 0) {
+        free(snap);
+        return -1;
+    }
+
+    snprintf(snap->name, sizeof(snap->name), "%s", name);
+    snap->epoch = SNAP_EPOCH;
+
+    for (i = 0; i < num_regions; i++) {
+        snap_region_t *r = &regions[i];
+
+        snap->pages[i] = calloc(r->num_pages, sizeof(snap_page_t *));
+        for (p = 0; p < r->num_pages; p++) {
+            uint64_t offset = (uint64_t)p << SNAP_PAGE_BITS;
+            uint32_t written = SNAP_PAGE_EPOCH[i][p];
+
+            if (offset >= r->size)
+                break;
+            /* an image taken in epoch E already holds every write stamped E */
+            if (written != 0 && (!r->latest[p] || written > r->latest_epoch[p])) {
+                uint64_t len = r->size - offset < SNAP_PAGE_SIZE ? r->size - offset : SNAP_PAGE_SIZE;
+                snap_page_t *page = malloc(sizeof(*page));
+
+                page->refs = 1;     /* held by r->latest */
+                memcpy(page->data, r->mem + offset, len);
+                memset(page->data + len, 0, SNAP_PAGE_SIZE - len);
+                page_release(r->latest[p]);
+                r->latest[p] = page;
+                r->latest_epoch[p] = SNAP_EPOCH;
+                copied++;
+            }
+            snap->pages[i][p] = r->latest[p];
+            if (r->latest[p])
+                r->latest[p]->refs++;
+        }
+    }
+
+    if (snapshots[slot])
+        drop(snapshots[slot]);
+    snapshots[slot] = snap;
+
+    /* writes from now on belong to a newer epoch than this snapshot */
+    SNAP_EPOCH++;
+    return copied;
+}
+
+/* Runs of differing words are merged and printed as they close */
+typedef struct {
+    FILE    *out;
+    uint64_t run_start, run_end;    /* open run of differing words, end exclusive */
+    uint64_t words, runs;
+} diff_state_t;
+
+static void flush_run(diff_state_t *d)
+{
+    uint64_t n;
+
+    if (d->run_end == d->run_start)
+        return;
+    n = (d->run_end - d->run_start) / 4;
+    printf("  0x%08" PRIx64 "..0x%08" PRIx64 " : %" PRIu64 " word%s\n",
+           d->run_start, d->run_end - 4, n, n == 1 ? "" : "s");
+    fprintf(d->out, "  0x%08" PRIx64 "..0x%08" PRIx64 " : %" PRIu64 " word%s\n",
+            d->run_start, d->run_end - 4, n, n == 1 ? "" : "s");
+    d->words += n;
+    d->runs++;
+    d->run_start = d->run_end = 0;
+}
+
+static void mark(diff_state_t *d, uint64_t address)
+{
+    if (d->run_end != d->run_start && d->run_end == address) {
+        d->run_end += 4;
+        return;
+    }
+    flush_run(d);
+    d->run_start = address;
+    d->run_end = address + 4;
+}
+
+/*
+ * Compare two page images one 64-bit word at a time, reporting runs of
+ * differing 32-bit simulator words. memcmp (vectorized by the C library)
+ * rejects equal pages first, so only pages that really changed are scanned.
+ */
+static void diff_page(diff_state_t *d, uint64_t base, const uint8_t *a, const uint8_t *b, uint64_t len)
+{
+    uint64_t i, x, y;
+
+    if (memcmp(a, b, len) == 0)
+        return;
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x == y)
+            continue;
+        if ((uint32_t)x != (uint32_t)y)
+            mark(d, base + i);
+        if ((x >> 32) != (y >> 32))
+            mark(d, base + i + 4);
+    }
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : snap_diff                                       */
+/*                                                             */
+/* Purpose   : Print the ranges of words that differ between   */
+/*             snapshot name and other, or the current memory  */
+/*             when other is NULL. Returns the number of       */
+/*             differing words, or -1 if a snapshot is unknown.*/
+/*                                                             */
+/***************************************************************/
+int snap_diff(FILE *out, const char *name, const char *other)
+{
+    snapshot_t *a = find(name), *b = other ? find(other) : NULL;
+    diff_state_t d = { out, 0, 0, 0, 0 };
+    int i;
+    uint32_t p;
+
+    if (!a || (other && !b))
+        return -1;
+
+    printf("\nMemory diff %s..%s :\n", name, other ? other : "current");
+    printf("-------------------------------------\n");
+    fprintf(out, "\nMemory diff %s..%s :\n", name, other ? other : "current");
+    fprintf(out, "-------------------------------------\n");
+
+    for (i = 0; i < num_regions; i++) {
+        snap_region_t *r = &regions[i];
+
+        for (p = 0; p < r->num_pages; p++) {
+            uint64_t offset = (uint64_t)p << SNAP_PAGE_BITS;
+            uint64_t len = r->size - offset < SNAP_PAGE_SIZE ? r->size - offset : SNAP_PAGE_SIZE;
+            const uint8_t *now;
+
+            if (offset >= r->size)
+                break;
+            if (b) {
+                if (a->pages[i][p] == b->pages[i][p])
+                    continue;
+                now = page_data(b->pages[i][p]);
+            } else {
+                if (SNAP_PAGE_EPOCH[i][p] <= a->epoch)
+                    continue;
+                now = r->mem + offset;
+            }
+            diff_page(&d, r->start + offset, page_data(a->pages[i][p]), now, len);
+        }
+        flush_run(&d);
+    }
+
+    printf("%" PRIu64 " words differ in %" PRIu64 " ranges\n\n", d.words, d.runs);
+    fprintf(out, "%" PRIu64 " words differ in %" PRIu64 " ranges\n\n", d.words, d.runs);
+    return (int)d.words;
+}
@@ -0,0 +1,43 @@
+/***************************************************************/
+/*                                                             */
+/*   ARM Instruction Level Simulator                           */
+/*                                                             */
+/*   Memory snapshots used by the snap and mdiff commands      */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_SNAP_H_
+#define _SIM_SNAP_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/*
+ * Memory is tracked in SNAP_PAGE_SIZE pages. mem_write_32 stamps the page
+ * it writes with the current epoch, and every snapshot closes an epoch, so
+ * a page whose stamp is not newer than a snapshot is known to be unchanged
+ * since it was taken. Snapshots only copy the pages written since the
+ * previous snapshot and share every other page with it, and mdiff only
+ * compares the pages stamped after the snapshot it diffs against.
+ */
+#define SNAP_PAGE_BITS   12
+#define SNAP_PAGE_SIZE   (1 << SNAP_PAGE_BITS)
+#define SNAP_MAX_REGIONS 4
+#define SNAP_MAX         16
+#define SNAP_NAME_LEN    32
+
+extern uint32_t  SNAP_EPOCH;
+extern uint32_t *SNAP_PAGE_EPOCH[SNAP_MAX_REGIONS];
+
+/* Called by mem_write_32 for a write at offset of region */
+static inline void snap_touch(int region, uint64_t offset)
+{
+    SNAP_PAGE_EPOCH[region][offset >> SNAP_PAGE_BITS] = SNAP_EPOCH;
+    SNAP_PAGE_EPOCH[region][(offset + 3) >> SNAP_PAGE_BITS] = SNAP_EPOCH;
+}
+
+void snap_add_region(int region, uint64_t start, uint64_t size, uint8_t *mem);
+int  snap_take(const char *name);
+int  snap_diff(FILE *out, const char *name, const char *other);
+
+#endif
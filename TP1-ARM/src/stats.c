@@ -0,0 +1,86 @@
+/***************************************************************/
+/*                                                             */
+/*   ARM Instruction Level Simulator                           */
+/*                                                             */
+/*   Performance counters                                      */
+/*                                                             */
+/***************************************************************/
+
+#include <time.h>
+#include "shell.h"
+#include "stats.h"
+
+sim_stats_t SIM_STATS;
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : stats_now_ns                                    */
+/*                                                             */
+/* Purpose   : Monotonic host time in nanoseconds              */
+/*                                                             */
+/***************************************************************/
+uint64_t stats_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : stats_mips                                      */
+/*                                                             */
+/* Purpose   : Simulated millions of instructions per host     */
+/*             second                                          */
+/*                                                             */
+/***************************************************************/
+double stats_mips(void)
+{
+    if (SIM_STATS.host_ns == 0)
+        return 0.0;
+    return (double)SIM_STATS.instructions * 1e3 / (double)SIM_STATS.host_ns;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : stats_print                                     */
+/*                                                             */
+/* Purpose   : Human readable dump, as printed by 'stats'      */
+/*                                                             */
+/***************************************************************/
+void stats_print(FILE *out)
+{
+    fprintf(out, "\nSimulator counters :\n");
+    fprintf(out, "-------------------------------------\n");
+    fprintf(out, "Instructions       : %" PRIu64 "\n", SIM_STATS.instructions);
+    fprintf(out, "Loads              : %" PRIu64 "\n", SIM_STATS.loads);
+    fprintf(out, "Stores             : %" PRIu64 "\n", SIM_STATS.stores);
+    fprintf(out, "Branches taken     : %" PRIu64 "\n", SIM_STATS.branches_taken);
+    fprintf(out, "Branches not taken : %" PRIu64 "\n", SIM_STATS.branches_not_taken);
+    fprintf(out, "Flag writes        : %" PRIu64 "\n", SIM_STATS.flag_writes);
+    fprintf(out, "Host time          : %.6f s\n", SIM_STATS.host_ns / 1e9);
+    fprintf(out, "MIPS               : %.3f\n", stats_mips());
+    fprintf(out, "\n");
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : stats_write_json                                */
+/*                                                             */
+/* Purpose   : Machine readable dump, used by --stats-json     */
+/*                                                             */
+/***************************************************************/
+void stats_write_json(FILE *out)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"instructions\": %" PRIu64 ",\n", SIM_STATS.instructions);
+    fprintf(out, "  \"loads\": %" PRIu64 ",\n", SIM_STATS.loads);
+    fprintf(out, "  \"stores\": %" PRIu64 ",\n", SIM_STATS.stores);
+    fprintf(out, "  \"branches_taken\": %" PRIu64 ",\n", SIM_STATS.branches_taken);
+    fprintf(out, "  \"branches_not_taken\": %" PRIu64 ",\n", SIM_STATS.branches_not_taken);
+    fprintf(out, "  \"flag_writes\": %" PRIu64 ",\n", SIM_STATS.flag_writes);
+    fprintf(out, "  \"host_ns\": %" PRIu64 ",\n", SIM_STATS.host_ns);
+    fprintf(out, "  \"mips\": %.3f\n", stats_mips());
+    fprintf(out, "}\n");
+}
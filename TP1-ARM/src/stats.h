@@ -0,0 +1,37 @@
+/***************************************************************/
+/*                                                             */
+/*   ARM Instruction Level Simulator                           */
+/*                                                             */
+/*   Performance counters                                      */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_STATS_H_
+#define _SIM_STATS_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/*
+ * Counters are only ever incremented while simulating forward; stepping
+ * back with rstep does not subtract from them, so they measure the work
+ * the host did rather than the architectural instruction count.
+ */
+typedef struct {
+    uint64_t instructions;
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t branches_taken;
+    uint64_t branches_not_taken;
+    uint64_t flag_writes;
+    uint64_t host_ns;           /* wall time spent inside go/run */
+} sim_stats_t;
+
+extern sim_stats_t SIM_STATS;
+
+uint64_t stats_now_ns(void);
+double   stats_mips(void);
+void     stats_print(FILE *out);
+void     stats_write_json(FILE *out);
+
+#endif
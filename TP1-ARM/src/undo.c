@@ -0,0 +1,247 @@
+/***************************************************************/
+/*                                                             */
+/*   ARM Instruction Level Simulator                           */
+/*                                                             */
+/*   Undo log used by the reverse execution commands           */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shell.h"
+#include "undo.h"
+
+/* What one instruction changed, besides the PC and flags kept in its step */
+typedef struct {
+    uint64_t where;     /* memory address, or register number */
+    int64_t  value;     /* value before the instruction ran */
+    int      is_reg;
+} undo_entry_t;
+
+typedef struct {
+    uint64_t pc;
+    uint32_t first_entry;
+    uint8_t  flag_n, flag_z, run_bit;
+} undo_step_t;
+
+typedef struct {
+    CPU_State     snapshot;         /* state before the first step */
+    int           snapshot_run_bit;
+    uint32_t      num_steps;
+    undo_step_t   steps[UNDO_CHUNK_STEPS];
+    undo_entry_t *entries;
+    uint32_t      num_entries, max_entries;
+} undo_chunk_t;
+
+int UNDO_RECORDING;
+
+/* ring of chunks, oldest at chunk_first; slots past the live ones are kept for reuse */
+static undo_chunk_t *chunks[UNDO_MAX_CHUNKS];
+static int chunk_first, chunk_count;
+
+static undo_chunk_t *current_chunk(void)
+{
+    if (chunk_count == 0)
+        return NULL;
+    return chunks[(chunk_first + chunk_count - 1) % UNDO_MAX_CHUNKS];
+}
+
+static undo_chunk_t *open_chunk(void)
+{
+    undo_chunk_t *chunk;
+    int slot;
+
+    if (chunk_count == UNDO_MAX_CHUNKS) {
+        /* forget the oldest history and recycle its buffers */
+        chunk_first = (chunk_first + 1) % UNDO_MAX_CHUNKS;
+        chunk_count--;
+    }
+
+    slot = (chunk_first + chunk_count) % UNDO_MAX_CHUNKS;
+    if (chunks[slot] == NULL) {
+        chunks[slot] = calloc(1, sizeof(undo_chunk_t));
+        if (chunks[slot] == NULL) {
+            printf("Error: Can't allocate undo log\n");
+            exit(-1);
+        }
+    }
+
+    chunk = chunks[slot];
+    chunk->snapshot = CURRENT_STATE;
+    chunk->snapshot_run_bit = RUN_BIT;
+    chunk->num_steps = 0;
+    chunk->num_entries = 0;
+    chunk_count++;
+    return chunk;
+}
+
+static void push_entry(undo_chunk_t *chunk, uint64_t where, int64_t value, int is_reg)
+{
+    undo_entry_t *entry;
+
+    if (chunk->num_entries == chunk->max_entries) {
+        chunk->max_entries = chunk->max_entries ? 2 * chunk->max_entries : UNDO_CHUNK_STEPS;
+        chunk->entries = realloc(chunk->entries, chunk->max_entries * sizeof(undo_entry_t));
+        if (chunk->entries == NULL) {
+            printf("Error: Can't allocate undo log\n");
+            exit(-1);
+        }
+    }
+
+    entry = &chunk->entries[chunk->num_entries++];
+    entry->where = where;
+    entry->value = value;
+    entry->is_reg = is_reg;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : undo_begin_step                                 */
+/*                                                             */
+/* Purpose   : Open a log record for the instruction about to  */
+/*             run and start logging its memory writes.        */
+/*                                                             */
+/***************************************************************/
+void undo_begin_step(void)
+{
+    undo_chunk_t *chunk = current_chunk();
+    undo_step_t *step;
+
+    if (chunk == NULL || chunk->num_steps == UNDO_CHUNK_STEPS)
+        chunk = open_chunk();
+
+    step = &chunk->steps[chunk->num_steps];
+    step->pc = CURRENT_STATE.PC;
+    step->flag_n = CURRENT_STATE.FLAG_N;
+    step->flag_z = CURRENT_STATE.FLAG_Z;
+    step->run_bit = RUN_BIT;
+    step->first_entry = chunk->num_entries;
+
+    UNDO_RECORDING = TRUE;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : undo_record_mem                                 */
+/*                                                             */
+/* Purpose   : Remember the word a memory write is about to    */
+/*             overwrite. Called from mem_write_32.            */
+/*                                                             */
+/***************************************************************/
+void undo_record_mem(uint64_t address, uint32_t old_value)
+{
+    push_entry(current_chunk(), address, old_value, FALSE);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : undo_end_step                                   */
+/*                                                             */
+/* Purpose   : Close the record of the instruction that just   */
+/*             ran, logging the registers it changed. Must run */
+/*             before NEXT_STATE is latched into CURRENT_STATE.*/
+/*                                                             */
+/***************************************************************/
+void undo_end_step(void)
+{
+    undo_chunk_t *chunk = current_chunk();
+    int k;
+
+    for (k = 0; k < ARM_REGS; k++)
+        if (NEXT_STATE.REGS[k] != CURRENT_STATE.REGS[k])
+            push_entry(chunk, k, CURRENT_STATE.REGS[k], TRUE);
+
+    chunk->num_steps++;
+    UNDO_RECORDING = FALSE;
+}
+
+/* Undo the memory writes of entries [first, last) in reverse order */
+static void restore_memory(undo_chunk_t *chunk, uint32_t first, uint32_t last)
+{
+    while (last-- > first)
+        if (!chunk->entries[last].is_reg)
+            mem_write_32(chunk->entries[last].where, (uint32_t)chunk->entries[last].value);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : undo_step_back                                  */
+/*                                                             */
+/* Purpose   : Roll the machine back by up to num_steps        */
+/*             instructions. Whole chunks are undone by        */
+/*             restoring memory and then reloading the chunk's */
+/*             snapshot, so the cost is proportional to the    */
+/*             distance stepped. Returns the number of         */
+/*             instructions actually undone.                   */
+/*                                                             */
+/***************************************************************/
+uint64_t undo_step_back(uint64_t num_steps)
+{
+    uint64_t done = 0;
+
+    while (done < num_steps && chunk_count > 0) {
+        undo_chunk_t *chunk = current_chunk();
+
+        if (num_steps - done >= chunk->num_steps) {
+            restore_memory(chunk, 0, chunk->num_entries);
+            CURRENT_STATE = chunk->snapshot;
+            RUN_BIT = chunk->snapshot_run_bit;
+            done += chunk->num_steps;
+            chunk_count--;
+            continue;
+        }
+
+        while (done < num_steps) {
+            undo_step_t *step = &chunk->steps[--chunk->num_steps];
+            uint32_t i;
+
+            restore_memory(chunk, step->first_entry, chunk->num_entries);
+            for (i = step->first_entry; i < chunk->num_entries; i++)
+                if (chunk->entries[i].is_reg)
+                    CURRENT_STATE.REGS[chunk->entries[i].where] = chunk->entries[i].value;
+            chunk->num_entries = step->first_entry;
+
+            CURRENT_STATE.PC = step->pc;
+            CURRENT_STATE.FLAG_N = step->flag_n;
+            CURRENT_STATE.FLAG_Z = step->flag_z;
+            RUN_BIT = step->run_bit;
+            done++;
+        }
+    }
+
+    NEXT_STATE = CURRENT_STATE;
+    INSTRUCTION_COUNT -= done;
+    return done;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : undo_available                                  */
+/*                                                             */
+/* Purpose   : Number of instructions that can be undone.      */
+/*                                                             */
+/***************************************************************/
+uint64_t undo_available(void)
+{
+    uint64_t total = 0;
+    int i;
+
+    for (i = 0; i < chunk_count; i++)
+        total += chunks[(chunk_first + i) % UNDO_MAX_CHUNKS]->num_steps;
+    return total;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : undo_reset                                      */
+/*                                                             */
+/* Purpose   : Drop all history, e.g. after the state has been */
+/*             changed by hand.                                */
+/*                                                             */
+/***************************************************************/
+void undo_reset(void)
+{
+    chunk_first = 0;
+    chunk_count = 0;
+}
@@ -0,0 +1,36 @@
+/***************************************************************/
+/*                                                             */
+/*   ARM Instruction Level Simulator                           */
+/*                                                             */
+/*   Undo log used by the reverse execution commands           */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_UNDO_H_
+#define _SIM_UNDO_H_
+
+#include <inttypes.h>
+
+/*
+ * The log is a ring of chunks. Each chunk starts with a full copy of the
+ * CPU state and then holds, for up to UNDO_CHUNK_STEPS instructions, the
+ * previous PC/flags and the previous value of every register and memory
+ * word the instruction wrote. When UNDO_MAX_CHUNKS are in use the oldest
+ * chunk is recycled, which bounds the history to roughly
+ * UNDO_CHUNK_STEPS * UNDO_MAX_CHUNKS instructions.
+ */
+#define UNDO_CHUNK_STEPS 4096
+#define UNDO_MAX_CHUNKS  256
+
+/* TRUE while an instruction is executing and its writes must be logged */
+extern int UNDO_RECORDING;
+
+void     undo_begin_step(void);
+void     undo_record_mem(uint64_t address, uint32_t old_value);
+void     undo_end_step(void);
+
+uint64_t undo_step_back(uint64_t num_steps);
+uint64_t undo_available(void);
+void     undo_reset(void);
+
+#endif
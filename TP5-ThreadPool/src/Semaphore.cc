@@ -1,6 +1,40 @@
-#include <mutex>
 #include "Semaphore.h"
-#include <condition_variable>
+#include "cpu-relax.h"
+#include <thread>
+#ifdef __linux__
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * How many times wait() retries for a permit before going to sleep. A
+ * short spin catches a signal() that is about to happen without paying
+ * for a sleep and a wakeup; on a single core it could only delay the
+ * thread that would signal, so it is skipped there.
+ */
+static const int kSpinCount = 100;
+
+#ifdef __linux__
+static_assert(sizeof(atomic<int>) == sizeof(int), "the futex word must be a plain int");
+
+/**
+ * @brief Sleeps while *word holds expected, until woken or until timeout
+ * (relative, NULL for none) elapses.
+ */
+static void futexWait(atomic<int> *word, int expected, const struct timespec *timeout) {
+    syscall(SYS_futex, reinterpret_cast<int *>(word), FUTEX_WAIT_PRIVATE, expected, timeout,
+            NULL, 0);
+}
+
+/**
+ * @brief Wakes up to n threads sleeping on word.
+ */
+static void futexWake(atomic<int> *word, int n) {
+    syscall(SYS_futex, reinterpret_cast<int *>(word), FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+#endif
 
 /**
  * @brief Constructs a Semaphore object with the specified initial count.
@@ -10,32 +44,123 @@
  *
  * @param count The initial count of the semaphore.
  */
-Semaphore::Semaphore(int count) : count_(count) {}
+Semaphore::Semaphore(int count) : count_(count), sleepers_(0) {}
 
 /**
- * Signals the semaphore, allowing one waiting thread to proceed.
+ * @brief Releases n permits, waking up to n sleeping threads.
+ *
+ * The permits are published before sleepers_ is read, and a sleeper
+ * registers in sleepers_ before its last look at the count (both
+ * sequentially consistent), so either the sleeper sees the permits or
+ * this sees the sleeper. Without sleepers, this is a single atomic add.
  */
-void Semaphore::signal () 
+void Semaphore::signal(int n)
 {
+    count_.fetch_add(n);
+    if (sleepers_.load() == 0) return;
+#ifdef __linux__
+    futexWake(&count_, n);
+#else
     lock_guard<mutex> lg(mutex_);
-    count_++;
-    if(count_ == 1) condition_.notify_all();
+    for (int i = 0; i < n; i++) condition_.notify_one();
+#endif
+}
+
+/**
+ * @brief Takes a permit if one is available, without blocking.
+ *
+ * @return true if a permit was acquired.
+ */
+bool Semaphore::try_wait()
+{
+    int count = count_.load();
+    while (count > 0) {
+        if (count_.compare_exchange_weak(count, count - 1, memory_order_acquire,
+                                         memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Retries try_wait() for a little while.
+ *
+ * @return true if a permit was acquired.
+ */
+bool Semaphore::spinWait()
+{
+    static const bool multicore = thread::hardware_concurrency() > 1;
+    if (!multicore) return false;
+    for (int i = 0; i < kSpinCount; i++) {
+        cpuRelax();
+        if (try_wait()) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Sleeps until a permit is acquired or deadline (if any) passes.
+ *
+ * @return true if a permit was acquired.
+ */
+bool Semaphore::sleep(const chrono::steady_clock::time_point *deadline)
+{
+    sleepers_.fetch_add(1);
+    bool acquired = false;
+#ifdef __linux__
+    while (!(acquired = try_wait())) {
+        if (deadline == NULL) {
+            futexWait(&count_, 0, NULL);
+            continue;
+        }
+        chrono::nanoseconds left = *deadline - chrono::steady_clock::now();
+        if (left <= chrono::nanoseconds::zero()) break;
+        struct timespec timeout;
+        timeout.tv_sec = left.count() / 1000000000;
+        timeout.tv_nsec = left.count() % 1000000000;
+        futexWait(&count_, 0, &timeout);
+    }
+#else
+    unique_lock<mutex> lock(mutex_);
+    if (deadline == NULL) {
+        condition_.wait(lock, [this] { return try_wait(); });
+        acquired = true;
+    } else {
+        acquired = condition_.wait_until(lock, *deadline, [this] { return try_wait(); });
+    }
+#endif
+    sleepers_.fetch_sub(1);
+    return acquired;
 }
 
 /**
  * @brief Waits until the semaphore is available and then acquires it.
- * 
+ *
  * This function blocks the current thread until the semaphore is available.
  * Once the semaphore becomes available, it is acquired by decrementing the count.
- * 
- * @note This function assumes that the caller has already acquired the lock associated with the semaphore.
- * 
+ *
  * @param None.
  * @return None.
  */
-void Semaphore::wait() 
+void Semaphore::wait()
 {
-    lock_guard<mutex> lg(mutex_);
-    condition_.wait(mutex_, [this](){return count_ > 0;});
-    count_--;
+    if (try_wait() || spinWait()) return;
+    sleep(NULL);
+}
+
+/**
+ * @brief Backs wait_for(): wait() with a deadline.
+ *
+ * @return true if a permit was acquired.
+ */
+bool Semaphore::waitFor(chrono::nanoseconds timeout)
+{
+    if (try_wait()) return true;
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now();
+    // a deadline past the clock's range (nanoseconds::max(), say) never comes
+    bool forever = timeout >= chrono::steady_clock::time_point::max() - deadline;
+    if (!forever) deadline += timeout;
+    if (spinWait()) return true;
+    return sleep(forever ? NULL : &deadline);
 }
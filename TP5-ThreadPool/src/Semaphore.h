@@ -1,8 +1,12 @@
 #ifndef _semaphore_
 #define _semaphore_
 
+#include <atomic>
+#include <chrono>
+#ifndef __linux__
 #include <condition_variable>
 #include <mutex>
+#endif
 
 using namespace std;
 
@@ -12,21 +16,51 @@ using namespace std;
  *
  * A semaphore is a synchronization primitive that controls access to a shared resource.
  * It allows multiple threads to access the resource concurrently, but with a limited capacity.
+ *
+ * The count lives in an atomic, so signal() and a wait() that finds a
+ * permit are a single atomic operation. A wait() that finds none spins
+ * briefly and then sleeps on a futex (on other systems, a condition
+ * variable); signal(n) wakes at most n sleepers.
  */
-class Semaphore 
+class Semaphore
 {
     public:
 
-        Semaphore(int count = 0); 
-        void signal ();
-        void wait(); 
+        Semaphore(int count = 0);
+        void signal(int n = 1);
+        void wait();
+        bool try_wait();
+
+        /**
+         * Like wait(), but gives up after the given time. Timeouts too
+         * long to represent (say, hours::max()) never run out.
+         *
+         * @return true if a permit was acquired.
+         */
+        template <typename Rep, typename Period>
+        bool wait_for(const chrono::duration<Rep, Period>& timeout) {
+            // compared as doubles, since converting them would overflow
+            typedef chrono::duration<double, nano> Nanos;
+            if (Nanos(timeout) <= Nanos::zero()) return waitFor(chrono::nanoseconds::zero());
+            if (Nanos(timeout) >= Nanos(chrono::nanoseconds::max())) {
+                return waitFor(chrono::nanoseconds::max());
+            }
+            return waitFor(chrono::duration_cast<chrono::nanoseconds>(timeout));
+        }
 
     private:
 
-        int count_;
+        bool spinWait();
+        bool waitFor(chrono::nanoseconds timeout);
+        bool sleep(const chrono::steady_clock::time_point *deadline);
+
+        atomic<int> count_;     // permits; also the futex word sleepers wait on
+        atomic<int> sleepers_;  // threads in (or about to enter) sleep()
+#ifndef __linux__
         mutex mutex_;
-        condition_variable_any condition_;
-        
+        condition_variable condition_;
+#endif
+
         Semaphore(const Semaphore& orig) = delete;              // no copy constructor
         Semaphore& operator=(const Semaphore& orig) = delete;   // no copy assignment
 };
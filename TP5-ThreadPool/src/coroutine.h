@@ -0,0 +1,252 @@
+/**
+ * File: coroutine.h
+ * -----------------
+ * Defines Task<T>, a C++20 coroutine returning a T, and sync_wait, which
+ * runs one to completion from ordinary code. Together with
+ * ThreadPool::schedule(), they let asynchronous steps be written one
+ * after the other instead of as nested callbacks:
+ *
+ *     Task<int> fetch(ThreadPool& pool) {
+ *         co_await pool.schedule();      // from here on, on a worker
+ *         co_return compute();
+ *     }
+ *     Task<int> twice(ThreadPool& pool) {
+ *         int first = co_await fetch(pool);
+ *         co_return first + co_await fetch(pool);
+ *     }
+ *     int result = sync_wait(twice(pool));
+ *
+ * A Task does not start until it is awaited (or passed to sync_wait).
+ * Awaiting it runs it on the awaiting thread until it suspends, and when
+ * it finishes, the coroutine awaiting it continues on the thread it
+ * finished on, so a continuation of a task that moved to the pool runs
+ * on the pool too. A suspended coroutine holds no thread.
+ *
+ * Only this header needs C++20; the rest of the pool builds as C++11.
+ */
+
+#ifndef _coroutine_
+#define _coroutine_
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutine.h needs C++20 coroutines (-std=c++20)"
+#endif
+
+#include <condition_variable>  // for condition_variable
+#include <coroutine>           // for coroutine_handle, suspend_always
+#include <exception>           // for exception_ptr
+#include <mutex>               // for mutex
+#include <optional>            // for optional
+#include <utility>             // for move, forward, exchange
+#include "thread-pool.h"       // for ThreadPool::schedule()
+
+using namespace std;
+
+template <typename T = void>
+class Task;
+
+/**
+ * @brief What the promises of every Task share: the task starts
+ * suspended, and on finishing resumes whoever awaited it (symmetric
+ * transfer, so long chains do not grow the stack).
+ */
+class TaskPromiseBase {
+  public:
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> finished) noexcept {
+            coroutine_handle<> next = finished.promise().continuation;
+            return next ? next : noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = current_exception(); }
+
+    coroutine_handle<> continuation;    // the coroutine awaiting this one
+    exception_ptr error;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+  public:
+    Task<T> get_return_object() noexcept;
+
+    template <typename U>
+    void return_value(U&& value) {
+        result.emplace(forward<U>(value));
+    }
+
+    T take() {
+        if (error) rethrow_exception(error);
+        return move(*result);
+    }
+
+  private:
+    optional<T> result;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+  public:
+    Task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+
+    void take() {
+        if (error) rethrow_exception(error);
+    }
+};
+
+template <typename T>
+class Task {
+  public:
+    typedef TaskPromise<T> promise_type;
+
+    Task(Task&& other) noexcept : coroutine(exchange(other.coroutine, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (coroutine) coroutine.destroy();
+            coroutine = exchange(other.coroutine, nullptr);
+        }
+        return *this;
+    }
+    ~Task() {
+        if (coroutine) coroutine.destroy();
+    }
+
+  /**
+  * Starts the task and suspends the awaiting coroutine until it
+  * finishes; evaluates to what the task co_returned, or rethrows what it
+  * threw.
+  */
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            coroutine_handle<promise_type> task;
+            bool await_ready() const noexcept { return task.done(); }
+            coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+                task.promise().continuation = awaiting;
+                return task;
+            }
+            T await_resume() { return task.promise().take(); }
+        };
+        return Awaiter{coroutine};
+    }
+
+  private:
+    friend class TaskPromise<T>;
+    explicit Task(coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+
+    coroutine_handle<promise_type> coroutine;
+
+    Task(const Task& original) = delete;
+    Task& operator=(const Task& rhs) = delete;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/**
+ * @brief The coroutine sync_wait runs a Task in: it awaits the task and
+ * then, suspended for good, tells the waiting thread it is done.
+ */
+class SyncWaiter {
+  public:
+    struct Done {
+        mutex lock;
+        condition_variable cond;
+        bool finished = false;
+    };
+
+    struct promise_type {
+        Done *done = nullptr;
+
+        struct NotifyAwaiter {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(coroutine_handle<promise_type> finished) const noexcept {
+                // the waiting thread destroys the coroutine once it sees this
+                Done& done = *finished.promise().done;
+                lock_guard<mutex> guard(done.lock);
+                done.finished = true;
+                done.cond.notify_one();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        SyncWaiter get_return_object() noexcept {
+            return SyncWaiter(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() const noexcept { return {}; }
+        NotifyAwaiter final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { terminate(); }
+    };
+
+    ~SyncWaiter() { coroutine.destroy(); }
+
+  /**
+  * Runs the coroutine and blocks until it has finished.
+  */
+    void run() {
+        Done done;
+        coroutine.promise().done = &done;
+        coroutine.resume();
+        unique_lock<mutex> guard(done.lock);
+        done.cond.wait(guard, [&done] { return done.finished; });
+    }
+
+  private:
+    explicit SyncWaiter(coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+    coroutine_handle<promise_type> coroutine;
+
+    SyncWaiter(const SyncWaiter& original) = delete;
+    SyncWaiter& operator=(const SyncWaiter& rhs) = delete;
+};
+
+template <typename T>
+SyncWaiter syncWaitFor(Task<T>& task, optional<T>& result, exception_ptr& error) {
+    try {
+        result.emplace(co_await move(task));
+    } catch (...) {
+        error = current_exception();
+    }
+}
+
+inline SyncWaiter syncWaitFor(Task<void>& task, exception_ptr& error) {
+    try {
+        co_await move(task);
+    } catch (...) {
+        error = current_exception();
+    }
+}
+
+/**
+ * @brief Runs task, blocking the calling thread until it finishes.
+ *
+ * @return What the task co_returned; what it threw is rethrown. Meant
+ * for code outside the pool: called from a thunk, it blocks a worker.
+ */
+template <typename T>
+T sync_wait(Task<T> task) {
+    optional<T> result;
+    exception_ptr error;
+    syncWaitFor(task, result, error).run();
+    if (error) rethrow_exception(error);
+    return move(*result);
+}
+
+inline void sync_wait(Task<void> task) {
+    exception_ptr error;
+    syncWaitFor(task, error).run();
+    if (error) rethrow_exception(error);
+}
+
+#endif
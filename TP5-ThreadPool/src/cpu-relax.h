@@ -0,0 +1,20 @@
+/**
+ * File: cpu-relax.h
+ * -----------------
+ * Defines cpuRelax, the pause that spin-wait loops (in Semaphore and in
+ * idle ThreadPool workers) issue between checks, which lets the other
+ * hyperthread of the core run and saves power while spinning.
+ */
+
+#ifndef _cpu_relax_
+#define _cpu_relax_
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * File: cpu-topology.cc
+ * ---------------------
+ * Presents the implementation of CpuTopology and the pinning helpers.
+ */
+
+#include "cpu-topology.h"
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+vector<int> parseCpuList(const string& list) {
+    vector<int> cpus;
+    stringstream ranges(list);
+    string range;
+    while (getline(ranges, range, ',')) {
+        if (range.find_first_of("0123456789") == string::npos) continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+CpuTopology CpuTopology::read(const string& nodeDir) {
+    CpuTopology topology;
+    DIR *dir = opendir(nodeDir.c_str());
+    if (dir != NULL) {
+        vector<pair<int, vector<int>>> found;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+                name.find_first_not_of("0123456789", 4) != string::npos) {
+                continue;
+            }
+            ifstream cpulist((nodeDir + "/" + name + "/cpulist").c_str());
+            string list;
+            if (!getline(cpulist, list)) continue;
+            vector<int> cpus = parseCpuList(list);
+            if (!cpus.empty()) found.push_back(make_pair(atoi(name.c_str() + 4), cpus));
+        }
+        closedir(dir);
+        // number the nodes that have CPUs 0, 1, ... in the kernel's order
+        sort(found.begin(), found.end());
+        for (auto& node : found) topology.nodeCpus.push_back(node.second);
+    }
+
+    if (topology.nodeCpus.empty()) {
+        unsigned n = thread::hardware_concurrency();
+        topology.nodeCpus.push_back(vector<int>());
+        for (unsigned cpu = 0; cpu < (n > 0 ? n : 1); cpu++) {
+            topology.nodeCpus[0].push_back(cpu);
+        }
+    }
+    for (size_t node = 0; node < topology.nodeCpus.size(); node++) {
+        for (int cpu : topology.nodeCpus[node]) {
+            if ((size_t)cpu >= topology.cpuNode.size()) topology.cpuNode.resize(cpu + 1, 0);
+            topology.cpuNode[cpu] = node;
+        }
+    }
+    return topology;
+}
+
+const CpuTopology& CpuTopology::system() {
+    static const CpuTopology topology = read("/sys/devices/system/node");
+    return topology;
+}
+
+size_t CpuTopology::nodeOf(int cpu) const {
+    return cpu >= 0 && (size_t)cpu < cpuNode.size() ? cpuNode[cpu] : 0;
+}
+
+size_t CpuTopology::currentNode() const {
+    return numNodes() > 1 ? nodeOf(currentCpu()) : 0;
+}
+
+int currentCpu() {
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+bool pinCurrentThread(const vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
@@ -0,0 +1,68 @@
+/**
+ * File: cpu-topology.h
+ * --------------------
+ * Defines CpuTopology, which tells which CPUs belong to which NUMA node
+ * (as listed under /sys/devices/system/node on Linux), and the helpers
+ * ThreadPool uses to pin its workers to CPUs. On systems without that
+ * information everything is one node and pinning does nothing.
+ */
+
+#ifndef _cpu_topology_
+#define _cpu_topology_
+
+#include <cstddef>  // for size_t
+#include <string>   // for string
+#include <vector>   // for vector
+
+using namespace std;
+
+class CpuTopology {
+  public:
+
+  /**
+  * The topology of the machine, read once.
+  */
+    static const CpuTopology& system();
+
+  /**
+  * Reads the topology from a sysfs-style directory holding node<N>/cpulist
+  * files. If there are none, all CPUs the machine reports form node 0.
+  */
+    static CpuTopology read(const string& nodeDir);
+
+    size_t numNodes() const { return nodeCpus.size(); }
+    const vector<int>& cpusOf(size_t node) const { return nodeCpus[node]; }
+
+  /**
+  * @return The node the given CPU belongs to, or 0 if it is unknown.
+  */
+    size_t nodeOf(int cpu) const;
+
+  /**
+  * @return The node of the CPU the calling thread is running on.
+  */
+    size_t currentNode() const;
+
+  private:
+    vector<vector<int>> nodeCpus;   // CPUs of each node, in ascending order
+    vector<size_t> cpuNode;         // node of each CPU
+};
+
+/**
+ * @brief Parses a kernel CPU list such as "0-3,8,10-11".
+ */
+vector<int> parseCpuList(const string& list);
+
+/**
+ * @brief Restricts the calling thread to the given CPUs.
+ *
+ * @return false if that is not supported or the kernel refused.
+ */
+bool pinCurrentThread(const vector<int>& cpus);
+
+/**
+ * @return The CPU the calling thread is running on, or -1 if unknown.
+ */
+int currentCpu();
+
+#endif
@@ -0,0 +1,239 @@
+/**
+ * File: future.h
+ * --------------
+ * Defines Future, the handle ThreadPool::submit returns for the result of
+ * a thunk. It behaves like a move-only std::future (get() hands the value
+ * over once, exceptions thrown by the thunk are rethrown by get()), but
+ * all of its state lives in a single allocation shared by the Future and
+ * the scheduled thunk, instead of the separate state, result and task
+ * objects std::packaged_task allocates.
+ */
+
+#ifndef _future_
+#define _future_
+
+#include <atomic>              // for atomic
+#include <chrono>              // for duration
+#include <condition_variable>  // for condition_variable
+#include <exception>           // for exception_ptr
+#include <future>              // for future_error
+#include <mutex>               // for mutex
+#include <tuple>               // for tuple
+#include <type_traits>         // for conditional, is_void, is_nothrow_move_constructible
+#include <utility>             // for move, forward, declval
+
+using namespace std;
+
+/**
+ * @brief Stands in for the value of a Future<void>.
+ */
+struct FutureUnit {};
+
+/**
+ * @brief The state a Future shares with the thunk producing its value.
+ * Reference counted by hand: one reference for the Future, one for the
+ * thunk.
+ */
+template <typename T>
+class FutureState {
+  public:
+    FutureState() : refs_(2), ready_(false), hasValue_(false) {}
+
+    ~FutureState() {
+        if (hasValue_) value().~T();
+    }
+
+    void release() {
+        if (refs_.fetch_sub(1, memory_order_acq_rel) == 1) delete this;
+    }
+
+    template <typename... A>
+    void setValue(A&&... args) {
+        lock_guard<mutex> lock(mutex_);
+        new (&storage_) T(forward<A>(args)...);
+        hasValue_ = true;
+        ready_.store(true, memory_order_release);
+        cond_.notify_all();
+    }
+
+    void setException(exception_ptr error) {
+        lock_guard<mutex> lock(mutex_);
+        error_ = error;
+        ready_.store(true, memory_order_release);
+        cond_.notify_all();
+    }
+
+    bool ready() const { return ready_.load(memory_order_acquire); }
+
+    void wait() {
+        if (ready()) return;
+        unique_lock<mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return ready(); });
+    }
+
+    template <typename Rep, typename Period>
+    bool waitFor(const chrono::duration<Rep, Period>& timeout) {
+        if (ready()) return true;
+        unique_lock<mutex> lock(mutex_);
+        return cond_.wait_for(lock, timeout, [this] { return ready(); });
+    }
+
+    T take() {
+        wait();
+        if (error_) rethrow_exception(error_);
+        return move(value());
+    }
+
+  private:
+    T& value() { return *reinterpret_cast<T *>(&storage_); }
+
+    atomic<int> refs_;
+    atomic<bool> ready_;
+    bool hasValue_;
+    exception_ptr error_;
+    typename aligned_storage<sizeof(T), alignof(T)>::type storage_;
+    mutex mutex_;
+    condition_variable cond_;
+};
+
+template <typename R>
+class Future {
+  public:
+    typedef typename conditional<is_void<R>::value, FutureUnit, R>::type value_type;
+
+    Future() : state_(nullptr) {}
+    explicit Future(FutureState<value_type> *state) : state_(state) {}
+    Future(Future&& other) : state_(other.state_) { other.state_ = nullptr; }
+
+    Future& operator=(Future&& other) {
+        if (this != &other) {
+            if (state_ != nullptr) state_->release();
+            state_ = other.state_;
+            other.state_ = nullptr;
+        }
+        return *this;
+    }
+
+    ~Future() {
+        if (state_ != nullptr) state_->release();
+    }
+
+  /**
+  * Blocks until the thunk has run, then returns its result (or rethrows
+  * what it threw). Like std::future::get, it can only be called once.
+  */
+    R get() {
+        FutureState<value_type> *state = state_;
+        state_ = nullptr;
+        struct releaser {
+            FutureState<value_type> *state;
+            ~releaser() { state->release(); }
+        } guard = {state};
+        return static_cast<R>(state->take());
+    }
+
+  /**
+  * Blocks until the result is available.
+  */
+    void wait() const { state_->wait(); }
+
+  /**
+  * Blocks until the result is available or timeout elapses.
+  *
+  * @return true if the result is available.
+  */
+    template <typename Rep, typename Period>
+    bool wait_for(const chrono::duration<Rep, Period>& timeout) const {
+        return state_->waitFor(timeout);
+    }
+
+    bool ready() const { return state_->ready(); }
+    bool valid() const { return state_ != nullptr; }
+
+  private:
+    FutureState<value_type> *state_;
+
+    Future(const Future& original) = delete;
+    Future& operator=(const Future& rhs) = delete;
+};
+
+template <size_t... I>
+struct IndexSequence {};
+
+template <size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct MakeIndexSequence<0, I...> {
+    typedef IndexSequence<I...> type;
+};
+
+/**
+ * @brief What SubmittedCall's call of an F with Args returns (the
+ * callable as an lvalue, the arguments as rvalues). Spelled with
+ * decltype since result_of is gone in C++20 and invoke_result is not in
+ * C++11.
+ */
+template <typename F, typename... Args>
+struct CallResult {
+    typedef decltype(declval<F&>()(declval<Args>()...)) type;
+};
+
+/**
+ * @brief The thunk submit() schedules: calls fn with the stored arguments
+ * (as rvalues, like std::thread) and publishes the outcome in the state.
+ * If it is destroyed without having run, the Future reports a broken
+ * promise instead of blocking forever.
+ */
+template <typename R, typename F, typename... Args>
+class SubmittedCall {
+  public:
+    typedef typename Future<R>::value_type value_type;
+
+    template <typename G, typename... A>
+    SubmittedCall(FutureState<value_type> *state, G&& fn, A&&... args)
+        : state_(state), fn_(forward<G>(fn)), args_(forward<A>(args)...) {}
+
+    // noexcept only when moving fn and the arguments is, since Thunk stores
+    // callables inline only if their move cannot throw
+    SubmittedCall(SubmittedCall&& other) noexcept(is_nothrow_move_constructible<F>::value &&
+                                                  is_nothrow_move_constructible<tuple<Args...>>::value)
+        : state_(other.state_), fn_(move(other.fn_)), args_(move(other.args_)) {
+        other.state_ = nullptr;
+    }
+
+    ~SubmittedCall() {
+        if (state_ != nullptr) {
+            state_->setException(make_exception_ptr(future_error(future_errc::broken_promise)));
+            state_->release();
+        }
+    }
+
+    void operator()() {
+        try {
+            run(is_void<R>(), typename MakeIndexSequence<sizeof...(Args)>::type());
+        } catch (...) {
+            state_->setException(current_exception());
+        }
+        state_->release();
+        state_ = nullptr;
+    }
+
+  private:
+    template <size_t... I>
+    void run(false_type /* void */, IndexSequence<I...>) {
+        state_->setValue(fn_(move(get<I>(args_))...));
+    }
+
+    template <size_t... I>
+    void run(true_type /* void */, IndexSequence<I...>) {
+        fn_(move(get<I>(args_))...);
+        state_->setValue();
+    }
+
+    FutureState<value_type> *state_;
+    F fn_;
+    tuple<Args...> args_;
+};
+
+#endif
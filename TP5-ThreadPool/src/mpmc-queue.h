@@ -0,0 +1,123 @@
+/**
+ * File: mpmc-queue.h
+ * ------------------
+ * Defines BoundedMPMCQueue, a fixed-capacity ring buffer any number of
+ * threads may push to and pop from without taking a lock. It is Dmitry
+ * Vyukov's bounded MPMC queue: every slot carries a sequence number that
+ * tells producers whether the slot is free for the lap they are on and
+ * consumers whether it holds the item of their lap, so each side only
+ * contends on its own position counter with a single CAS.
+ */
+
+#ifndef _mpmc_queue_
+#define _mpmc_queue_
+
+#include <atomic>    // for atomic
+#include <cstddef>   // for size_t
+#include <cstdint>   // for intptr_t
+#include <utility>   // for move
+#include "work-stealing-deque.h" // for kCacheLineSize
+
+using namespace std;
+
+template <typename T>
+class BoundedMPMCQueue {
+  public:
+
+  /**
+  * Constructs an empty queue holding up to capacity items (rounded up to
+  * a power of two, at least 2).
+  */
+    explicit BoundedMPMCQueue(size_t capacity) : enqueuePos_(0), dequeuePos_(0) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask_ = size - 1;
+        cells_ = new Cell[size];
+        for (size_t i = 0; i < size; i++) {
+            cells_[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    ~BoundedMPMCQueue() { delete[] cells_; }
+
+  /**
+  * Appends item unless the queue is full.
+  *
+  * @return false if the queue was full; item is left untouched.
+  */
+    bool tryPush(T& item) {
+        size_t pos = enqueuePos_.load(memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;    // the slot still holds last lap's item
+            } else {
+                pos = enqueuePos_.load(memory_order_relaxed);
+            }
+        }
+        cell->data = move(item);
+        cell->sequence.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+  /**
+  * Removes the oldest item into item.
+  *
+  * @return false if the queue was empty.
+  */
+    bool tryPop(T& item) {
+        size_t pos = dequeuePos_.load(memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;    // nothing published in this slot yet
+            } else {
+                pos = dequeuePos_.load(memory_order_relaxed);
+            }
+        }
+        item = move(cell->data);
+        cell->sequence.store(pos + mask_ + 1, memory_order_release);
+        return true;
+    }
+
+  /**
+  * Number of items, only exact when no other thread is using the queue.
+  */
+    size_t sizeApprox() const {
+        size_t tail = enqueuePos_.load(memory_order_relaxed);
+        size_t head = dequeuePos_.load(memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+  private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T data;
+    };
+
+    char padStart_[kCacheLineSize];
+    Cell *cells_;
+    size_t mask_;
+    char padCells_[kCacheLineSize - sizeof(Cell *) - sizeof(size_t)];
+    atomic<size_t> enqueuePos_;
+    char padEnqueue_[kCacheLineSize - sizeof(atomic<size_t>)];
+    atomic<size_t> dequeuePos_;
+    char padDequeue_[kCacheLineSize - sizeof(atomic<size_t>)];
+
+    BoundedMPMCQueue(const BoundedMPMCQueue& original) = delete;
+    BoundedMPMCQueue& operator=(const BoundedMPMCQueue& rhs) = delete;
+};
+
+#endif
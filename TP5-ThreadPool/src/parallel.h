@@ -0,0 +1,206 @@
+/**
+ * File: parallel.h
+ * ----------------
+ * Defines parallel_for and parallel_reduce, which split an index range
+ * into chunks and run them on a ThreadPool, so data-parallel loops need
+ * no hand-written partitioning. The chunking is picked with a
+ * PartitionKind:
+ *
+ *   - kStaticPartition: one equal chunk per pool thread. Cheapest, for
+ *     loops whose iterations all cost about the same.
+ *   - kGuidedPartition: chunks that shrink as the range is consumed,
+ *     claimed in order by one runner per pool thread, so the threads
+ *     finish close together even when iterations vary.
+ *   - kAdaptivePartition (the default): grain-sized chunks handed out by
+ *     recursive halving. Each half lands on the deque of the worker that
+ *     split it, so idle workers steal the biggest pending pieces.
+ *
+ * Each loop runs its chunks as a TaskGroup, so it waits only for its own
+ * chunks, and a loop started by a thunk already running on the pool
+ * helps run the pool's queued thunks while it waits.
+ */
+
+#ifndef _parallel_
+#define _parallel_
+
+#include <atomic>              // for atomic
+#include <utility>             // for move
+#include <vector>              // for vector
+#include "thread-pool.h"       // for ThreadPool
+#include "task-group.h"        // for TaskGroup
+
+using namespace std;
+
+/**
+ * @brief The half-open range of indices [begin, end).
+ */
+struct IndexRange {
+    size_t begin;
+    size_t end;
+
+    size_t size() const { return end > begin ? end - begin : 0; }
+};
+
+enum PartitionKind {
+    kStaticPartition,     // one equal chunk per thread
+    kGuidedPartition,     // shrinking chunks claimed in order
+    kAdaptivePartition    // grain-sized chunks spread by work stealing
+};
+
+/**
+ * @brief What the chunks of one loop share: their bounds, the function
+ * running a chunk and the TaskGroup tracking them.
+ */
+template <typename ChunkFn>
+class ParallelJob {
+  public:
+    ParallelJob(TaskGroup& group, vector<size_t>&& bounds, ChunkFn& fn)
+        : group_(group), bounds_(move(bounds)), fn_(fn), nextChunk_(0) {}
+
+    size_t numChunks() const { return bounds_.size() - 1; }
+
+    void runChunk(size_t chunk) { fn_(chunk, bounds_[chunk], bounds_[chunk + 1]); }
+
+  /**
+  * Runs chunks in the order they are claimed until there are none left
+  * (or a chunk threw and cancelled the group).
+  */
+    void runClaimedChunks() {
+        size_t chunk;
+        while (!group_.is_cancelled() && (chunk = nextChunk_++) < numChunks()) runChunk(chunk);
+    }
+
+  /**
+  * Runs chunks [lo, hi): keeps halving the range, running the upper
+  * half as a new thunk of the group, and runs the single chunk left.
+  */
+    void splitChunks(size_t lo, size_t hi) {
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            group_.run([this, mid, hi] { splitChunks(mid, hi); });
+            hi = mid;
+        }
+        runChunk(lo);
+    }
+
+  private:
+    TaskGroup& group_;
+    vector<size_t> bounds_;      // chunk i is [bounds_[i], bounds_[i + 1])
+    ChunkFn& fn_;
+    atomic<size_t> nextChunk_;   // next chunk to claim, for kGuidedPartition
+};
+
+/**
+ * @brief Splits range into the chunks the given partitioner uses. A grain
+ * of 0 picks one: 1 for the static and guided partitioners, enough for
+ * about 8 chunks per thread for the adaptive one.
+ */
+inline vector<size_t> partitionRange(IndexRange range, size_t grain, PartitionKind kind,
+                                     size_t numThreads) {
+    size_t n = range.size();
+    vector<size_t> bounds(1, range.begin);
+    if (kind == kGuidedPartition) {
+        if (grain == 0) grain = 1;
+        size_t left = n;
+        while (left > 0) {
+            size_t chunk = (left + 2 * numThreads - 1) / (2 * numThreads);
+            if (chunk < grain) chunk = grain;
+            if (chunk > left) chunk = left;
+            left -= chunk;
+            bounds.push_back(range.end - left);
+        }
+        return bounds;
+    }
+
+    size_t numChunks;
+    if (kind == kStaticPartition) {
+        numChunks = grain > 0 ? (n + grain - 1) / grain : n;
+        if (numChunks > numThreads) numChunks = numThreads;
+    } else {
+        if (grain == 0) grain = n / (8 * numThreads) > 0 ? n / (8 * numThreads) : 1;
+        numChunks = (n + grain - 1) / grain;
+    }
+    for (size_t i = 1; i <= numChunks; i++) {
+        bounds.push_back(range.begin + n / numChunks * i + n % numChunks * i / numChunks);
+    }
+    return bounds;
+}
+
+/**
+ * @brief Runs fn(chunk, begin, end) for every chunk in bounds (as built by
+ * partitionRange for kind) on the pool and waits for all of them.
+ */
+template <typename ChunkFn>
+void runChunks(ThreadPool& pool, vector<size_t>&& bounds, PartitionKind kind, ChunkFn& fn) {
+    if (bounds.size() < 2) return;
+    TaskGroup group(pool);
+    ParallelJob<ChunkFn> job(group, move(bounds), fn);
+
+    switch (kind) {
+    case kStaticPartition:
+        group.run_n(job.numChunks(), [&job](size_t chunk) { job.runChunk(chunk); });
+        break;
+    case kGuidedPartition: {
+        size_t runners = pool.num_threads() < job.numChunks() ? pool.num_threads() : job.numChunks();
+        group.run_n(runners, [&job](size_t) { job.runClaimedChunks(); });
+        break;
+    }
+    case kAdaptivePartition:
+        group.run([&job] { job.splitChunks(0, job.numChunks()); });
+        break;
+    }
+    group.wait();
+}
+
+/**
+ * @brief Calls body(i) for every i in range, in parallel on the pool, and
+ * returns once all calls have. If some call throws, the chunks not yet
+ * started are skipped and the first exception is rethrown here.
+ *
+ * @param grain The chunk size (the minimum one for kGuidedPartition), or
+ * 0 to let the partitioner choose.
+ */
+template <typename Body>
+void parallel_for(ThreadPool& pool, IndexRange range, size_t grain, Body body,
+                  PartitionKind kind = kAdaptivePartition) {
+    auto chunkFn = [&body](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) body(i);
+    };
+    runChunks(pool, partitionRange(range, grain, kind, pool.num_threads()), kind, chunkFn);
+}
+
+/**
+ * @brief One chunk's result in parallel_reduce. Wrapped so partials are
+ * separate objects even for T = bool, which vector<T> would pack into
+ * shared words that chunks finishing together would race on.
+ */
+template <typename T>
+struct ReducePartial {
+    T value;
+};
+
+/**
+ * @brief Computes combine(...combine(combine(identity, map(begin)),
+ * map(begin + 1))..., map(end - 1)) in parallel on the pool. Each chunk
+ * folds its indices starting from identity and the chunk results are
+ * combined in index order, so combine needs to be associative but not
+ * commutative. Exceptions are handled as in parallel_for.
+ */
+template <typename T, typename Map, typename Combine>
+T parallel_reduce(ThreadPool& pool, IndexRange range, T identity, Map map, Combine combine,
+                  size_t grain = 0, PartitionKind kind = kAdaptivePartition) {
+    vector<size_t> bounds = partitionRange(range, grain, kind, pool.num_threads());
+    vector<ReducePartial<T>> partials(bounds.size() - 1, ReducePartial<T>{identity});
+    auto chunkFn = [&](size_t chunk, size_t begin, size_t end) {
+        T acc = identity;
+        for (size_t i = begin; i < end; i++) acc = combine(move(acc), map(i));
+        partials[chunk].value = move(acc);
+    };
+    runChunks(pool, move(bounds), kind, chunkFn);
+
+    T result = move(identity);
+    for (ReducePartial<T>& partial : partials) result = combine(move(result), move(partial.value));
+    return result;
+}
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * File: pool-stats.cc
+ * -------------------
+ * Presents the implementation of the pool statistics histograms.
+ */
+
+#include "pool-stats.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+static const uint64_t kSubBuckets = 1 << Histogram::kSubBucketBits;
+
+size_t Histogram::bucketOf(uint64_t value) {
+    if (value < kSubBuckets) return value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kSubBucketBits;
+    // the top kSubBucketBits + 1 bits of value, the first of them set
+    uint64_t top = value >> shift;
+    return (shift + 1) * kSubBuckets + (top - kSubBuckets);
+}
+
+uint64_t Histogram::bucketHigh(size_t bucket) {
+    if (bucket < kSubBuckets) return bucket;
+    int shift = bucket / kSubBuckets - 1;
+    uint64_t top = kSubBuckets + bucket % kSubBuckets;
+    return (top << shift) + ((uint64_t(1) << shift) - 1);
+}
+
+Histogram::Histogram()
+    : counts(kNumBuckets, 0), total(0), sum(0), minValue(numeric_limits<uint64_t>::max()),
+      maxValue(0) {}
+
+void Histogram::record(uint64_t value, uint64_t times) {
+    if (times == 0) return;
+    counts[bucketOf(value)] += times;
+    total += times;
+    sum += value * times;
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+}
+
+void Histogram::merge(const Histogram& other) {
+    for (size_t b = 0; b < kNumBuckets; b++) counts[b] += other.counts[b];
+    total += other.total;
+    sum += other.sum;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
+uint64_t Histogram::percentile(double percent) const {
+    if (total == 0) return 0;
+    // the rank-th smallest value, counting from 1
+    uint64_t rank = (uint64_t)(percent / 100 * total + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, total));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kNumBuckets; b++) {
+        seen += counts[b];
+        if (seen >= rank) return std::max(minValue, std::min(bucketHigh(b), maxValue));
+    }
+    return maxValue;
+}
+
+void Histogram::write_json(ostream& out) const {
+    out << "{\"count\": " << total << ", \"min\": " << min() << ", \"mean\": " << mean()
+        << ", \"p50\": " << percentile(50) << ", \"p90\": " << percentile(90)
+        << ", \"p99\": " << percentile(99) << ", \"p999\": " << percentile(99.9)
+        << ", \"max\": " << max() << "}";
+}
+
+HistogramRecorder::HistogramRecorder()
+    : sum(0), min(numeric_limits<uint64_t>::max()), max(0) {
+    for (atomic<uint64_t>& count : counts) count.store(0, memory_order_relaxed);
+}
+
+void HistogramRecorder::add_to(Histogram& histogram) const {
+    uint64_t total = 0;
+    for (size_t b = 0; b < Histogram::kNumBuckets; b++) {
+        uint64_t count = counts[b].load(memory_order_acquire);
+        histogram.counts[b] += count;
+        total += count;
+    }
+    if (total == 0) return;
+    histogram.total += total;
+    histogram.sum += sum.load(memory_order_relaxed);
+    histogram.minValue = std::min(histogram.minValue, min.load(memory_order_relaxed));
+    histogram.maxValue = std::max(histogram.maxValue, max.load(memory_order_relaxed));
+}
+
+void PoolStats::add(const WorkerStats& thread, WorkerTime *worker) {
+    Histogram runs;
+    thread.runTime.add_to(runs);
+    runTime.merge(runs);
+    thread.queueLatency.add_to(queueLatency);
+    thread.queueDepth.add_to(queueDepth);
+
+    WorkerTime& time = worker != nullptr ? *worker : outside;
+    time.tasks += runs.count();
+    time.busy += thread.busy.load(memory_order_relaxed);
+    time.idle += thread.idle.load(memory_order_relaxed);
+}
+
+static void writeTime(ostream& out, const PoolStats::WorkerTime& time) {
+    out << "{\"tasks\": " << time.tasks << ", \"busy_ns\": " << time.busy << ", \"idle_ns\": "
+        << time.idle << ", \"utilization\": " << time.utilization() << "}";
+}
+
+void PoolStats::write_json(ostream& out) const {
+    out << "{\"enabled\": " << (enabled ? "true" : "false") << ",\n \"queue_latency_ns\": ";
+    queueLatency.write_json(out);
+    out << ",\n \"run_time_ns\": ";
+    runTime.write_json(out);
+    out << ",\n \"queue_depth\": ";
+    queueDepth.write_json(out);
+    out << ",\n \"workers\": [";
+    for (size_t i = 0; i < workers.size(); i++) {
+        out << (i == 0 ? "\n  " : ",\n  ");
+        writeTime(out, workers[i]);
+    }
+    out << "],\n \"outside\": ";
+    writeTime(out, outside);
+    out << "}\n";
+}
@@ -0,0 +1,156 @@
+/**
+ * File: pool-stats.h
+ * ------------------
+ * Defines the histograms ThreadPool fills in when it is built with
+ * THREADPOOL_STATS defined, and PoolStats, the snapshot of them that
+ * ThreadPool::stats() returns.
+ *
+ * Histograms are log-linear, as in HdrHistogram: values below 16 get a
+ * bucket each, and every power of two above that is split into 16
+ * buckets, so any value is known to within 1/16 (about 6%) with under a
+ * thousand buckets for the whole 64-bit range.
+ *
+ * Each worker records into its own HistogramRecorder, which only that
+ * worker writes (with plain relaxed loads and stores, no read-modify-
+ * write), and stats() adds them all up when asked.
+ */
+
+#ifndef _pool_stats_
+#define _pool_stats_
+
+#include <atomic>    // for atomic
+#include <cstddef>   // for size_t
+#include <cstdint>   // for uint64_t
+#include <ostream>   // for ostream
+#include <vector>    // for vector
+
+using namespace std;
+
+class Histogram {
+  public:
+    static const int kSubBucketBits = 4;
+    static const size_t kNumBuckets = (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+  /**
+  * @return The bucket value falls in.
+  */
+    static size_t bucketOf(uint64_t value);
+
+  /**
+  * @return The largest value that falls in bucket.
+  */
+    static uint64_t bucketHigh(size_t bucket);
+
+    Histogram();
+
+    void record(uint64_t value, uint64_t times = 1);
+    void merge(const Histogram& other);
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total == 0 ? 0 : minValue; }
+    uint64_t max() const { return maxValue; }
+    double mean() const { return total == 0 ? 0 : (double)sum / total; }
+
+  /**
+  * @return A value (accurate to its bucket) that percent percent of the
+  * recorded values are at most, or 0 if there are none.
+  */
+    uint64_t percentile(double percent) const;
+
+  /**
+  * Writes count, min, mean, max and the 50th, 90th, 99th and 99.9th
+  * percentiles as a JSON object.
+  */
+    void write_json(ostream& out) const;
+
+  private:
+    friend class HistogramRecorder;
+
+    vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t minValue;
+    uint64_t maxValue;
+};
+
+/**
+ * @brief A Histogram that one thread records into while others read it.
+ */
+class HistogramRecorder {
+  public:
+    HistogramRecorder();
+
+  /**
+  * Only one thread at a time may record.
+  */
+    void record(uint64_t value) {
+        bump(sum, value);
+        if (value > max.load(memory_order_relaxed)) max.store(value, memory_order_relaxed);
+        if (value < min.load(memory_order_relaxed)) min.store(value, memory_order_relaxed);
+        // released last, so a reader that sees the count sees the rest too
+        atomic<uint64_t>& count = counts[Histogram::bucketOf(value)];
+        count.store(count.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+  /**
+  * Adds what has been recorded so far to histogram.
+  */
+    void add_to(Histogram& histogram) const;
+
+  private:
+    static void bump(atomic<uint64_t>& counter, uint64_t by) {
+        counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+    }
+
+    atomic<uint64_t> counts[Histogram::kNumBuckets];
+    atomic<uint64_t> sum;
+    atomic<uint64_t> min;
+    atomic<uint64_t> max;
+};
+
+/**
+ * @brief What one thread records while running thunks. Only that thread
+ * writes it.
+ */
+struct WorkerStats {
+    HistogramRecorder queueLatency;   // nanoseconds from schedule to start
+    HistogramRecorder runTime;        // nanoseconds each thunk ran
+    HistogramRecorder queueDepth;     // unfinished thunks when one starts
+    atomic<uint64_t> busy{0};         // nanoseconds running thunks
+    atomic<uint64_t> idle{0};         // nanoseconds looking for work or asleep
+    atomic<uint64_t> idleSince{0};    // when it last ran out of work, 0 if busy
+};
+
+/**
+ * @brief A snapshot of a pool's statistics. All empty if the pool was
+ * built without THREADPOOL_STATS.
+ */
+struct PoolStats {
+    struct WorkerTime {
+        uint64_t tasks = 0;
+        uint64_t busy = 0;    // nanoseconds
+        uint64_t idle = 0;    // nanoseconds
+
+      /**
+      * @return The fraction of its time the thread spent running thunks.
+      */
+        double utilization() const { return busy + idle == 0 ? 0 : (double)busy / (busy + idle); }
+    };
+
+    bool enabled = false;
+    Histogram queueLatency;
+    Histogram runTime;
+    Histogram queueDepth;
+    vector<WorkerTime> workers;   // one per worker slot
+    WorkerTime outside;           // threads outside the pool (helping waits)
+
+  /**
+  * Adds what thread recorded: its histograms, and its times as worker
+  * (or as the outside threads, if worker is null).
+  */
+    void add(const WorkerStats& thread, WorkerTime *worker);
+
+    void write_json(ostream& out) const;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * File: task-graph.cc
+ * -------------------
+ * Presents the implementation of the TaskGraph class.
+ */
+
+#include "task-graph.h"
+#include <stdexcept>
+
+using namespace std;
+
+TaskGraph::TaskGraph() : prepared(false) {}
+
+void TaskGraph::add_predecessor(TaskId task, TaskId predecessor) {
+    if (task >= nodes.size() || predecessor >= nodes.size()) {
+        throw out_of_range("La tarea no pertenece al TaskGraph.");
+    }
+    nodes[predecessor]->successors.push_back(task);
+    nodes[task]->numPredecessors++;
+    prepared = false;
+}
+
+/**
+ * @brief Finds the roots and checks that every task can run, by
+ * topologically sorting the graph (Kahn's algorithm). Only needed after
+ * the graph changes.
+ */
+void TaskGraph::prepare() {
+    roots.clear();
+    vector<size_t> waitingFor(nodes.size());
+    vector<TaskId> ready;
+    for (TaskId id = 0; id < nodes.size(); id++) {
+        waitingFor[id] = nodes[id]->numPredecessors;
+        if (waitingFor[id] == 0) ready.push_back(id);
+    }
+    roots = ready;
+
+    size_t sorted = 0;
+    while (!ready.empty()) {
+        TaskId id = ready.back();
+        ready.pop_back();
+        sorted++;
+        for (TaskId successor : nodes[id]->successors) {
+            if (--waitingFor[successor] == 0) ready.push_back(successor);
+        }
+    }
+    if (sorted != nodes.size()) throw logic_error("El TaskGraph tiene un ciclo.");
+    prepared = true;
+}
+
+/**
+ * @brief Runs a task, then releases its successors: the ones it brings
+ * to zero pending predecessors are started, all but one as new thunks
+ * of the group and the last one right here, which spares a trip through
+ * the pool along chains of tasks.
+ */
+void TaskGraph::runTask(TaskId id, TaskGroup& group) {
+    while (true) {
+        Node& node = *nodes[id];
+        node.fn();
+
+        TaskId next = nodes.size();
+        for (TaskId successor : node.successors) {
+            if (nodes[successor]->waitingFor.fetch_sub(1, memory_order_acq_rel) != 1) continue;
+            if (next != nodes.size()) {
+                group.run([this, next, &group] { runTask(next, group); });
+            }
+            next = successor;
+        }
+        if (next == nodes.size() || group.is_cancelled()) return;
+        id = next;
+    }
+}
+
+void TaskGraph::run(ThreadPool& pool) {
+    if (!prepared) prepare();
+    for (unique_ptr<Node>& node : nodes) {
+        node->waitingFor.store(node->numPredecessors, memory_order_relaxed);
+    }
+
+    TaskGroup group(pool);
+    group.run_n(roots.size(), [this, &group](size_t k) { runTask(roots[k], group); });
+    group.wait();
+}
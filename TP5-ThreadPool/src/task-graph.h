@@ -0,0 +1,85 @@
+/**
+ * File: task-graph.h
+ * ------------------
+ * Defines TaskGraph, a set of thunks with dependencies between them that
+ * runs on a ThreadPool. Each task starts as soon as all its predecessors
+ * have finished: a task's count of unfinished predecessors is an atomic
+ * that its predecessors decrement, and whichever brings it to zero
+ * starts it, so there is no barrier (and no lock) between stages.
+ *
+ * A graph is built once and can then be run any number of times; a run
+ * only resets the counters.
+ */
+
+#ifndef _task_graph_
+#define _task_graph_
+
+#include <atomic>            // for atomic
+#include <cstddef>           // for size_t
+#include <initializer_list>  // for initializer_list
+#include <memory>            // for unique_ptr
+#include <utility>           // for forward
+#include <vector>            // for vector
+#include "thread-pool.h"     // for ThreadPool
+#include "task-group.h"      // for TaskGroup
+#include "thunk.h"           // for Thunk
+
+using namespace std;
+
+class TaskGraph {
+  public:
+    typedef size_t TaskId;
+
+    TaskGraph();
+
+  /**
+  * Adds a task running fn (which is kept and called once per run) that
+  * starts once all the given tasks have finished.
+  *
+  * @return The new task's id.
+  */
+    template <typename F>
+    TaskId add(F&& fn, initializer_list<TaskId> predecessors = {}) {
+        TaskId id = nodes.size();
+        nodes.push_back(unique_ptr<Node>(new Node(Thunk(forward<F>(fn)))));
+        for (TaskId predecessor : predecessors) add_predecessor(id, predecessor);
+        return id;
+    }
+
+  /**
+  * Makes task wait for predecessor to finish.
+  */
+    void add_predecessor(TaskId task, TaskId predecessor);
+
+  /**
+  * Runs every task once on pool and waits for all of them. If a task
+  * throws, the tasks that depend on it (and any not started yet) are
+  * skipped and the first exception is rethrown here. Throws logic_error
+  * if the dependencies contain a cycle. A graph must not be run twice at
+  * the same time.
+  */
+    void run(ThreadPool& pool);
+
+    size_t size() const { return nodes.size(); }
+
+  private:
+    struct Node {
+        explicit Node(Thunk&& fn) : fn(move(fn)), numPredecessors(0), waitingFor(0) {}
+        Thunk fn;
+        vector<TaskId> successors;
+        size_t numPredecessors;
+        atomic<size_t> waitingFor;   // predecessors not finished in this run
+    };
+
+    void prepare();
+    void runTask(TaskId id, TaskGroup& group);
+
+    vector<unique_ptr<Node>> nodes;
+    vector<TaskId> roots;    // tasks without predecessors
+    bool prepared;           // roots are up to date and there are no cycles
+
+    TaskGraph(const TaskGraph& original) = delete;
+    TaskGraph& operator=(const TaskGraph& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * File: task-group.cc
+ * -------------------
+ * Presents the implementation of the TaskGroup class.
+ */
+
+#include "task-group.h"
+#include <chrono>
+
+using namespace std;
+
+/**
+ * How long a worker waiting for a group sleeps when it finds no queued
+ * thunk to help with, before looking again. The group's own thunks may
+ * spawn more work on other workers' deques at any time, and that does
+ * not signal the group.
+ */
+static const chrono::microseconds kHelpInterval(100);
+
+TaskGroup::TaskGroup(ThreadPool& pool) : pool_(pool), pending_(0), cancelled_(false) {}
+
+TaskGroup::~TaskGroup() {
+    waitForTasks();
+}
+
+void TaskGroup::cancel() {
+    cancelled_ = true;
+}
+
+/**
+ * @brief Records the first exception a thunk threw and cancels the rest
+ * of the group.
+ */
+void TaskGroup::fail(exception_ptr error) {
+    lock_guard<mutex> lock(mutex_);
+    if (!error_) error_ = error;
+    cancelled_ = true;
+}
+
+/**
+ * @brief Takes count finished thunks off pending_.
+ *
+ * Only the update that brings pending_ to zero is made under mutex_, and
+ * wait() returns only after taking mutex_, so once a waiter sees the
+ * group done no thunk is still touching it (the group may be destroyed
+ * right away).
+ */
+void TaskGroup::finishTasks(size_t count) {
+    size_t pending = pending_.load();
+    while (pending > count) {
+        if (pending_.compare_exchange_weak(pending, pending - count)) return;
+    }
+    lock_guard<mutex> lock(mutex_);
+    if (pending_.fetch_sub(count) == count) cond_.notify_all();
+}
+
+void TaskGroup::waitForTasks() {
+    if (pool_.is_worker_thread()) {
+        while (pending_ > 0) {
+            if (pool_.run_pending_task()) continue;
+            unique_lock<mutex> lock(mutex_);
+            cond_.wait_for(lock, kHelpInterval, [this] { return pending_ == 0; });
+        }
+    }
+    unique_lock<mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void TaskGroup::wait() {
+    waitForTasks();
+    exception_ptr error;
+    {
+        lock_guard<mutex> lock(mutex_);
+        swap(error, error_);
+        cancelled_ = false;
+    }
+    if (error) rethrow_exception(error);
+}
@@ -0,0 +1,144 @@
+/**
+ * File: task-group.h
+ * ------------------
+ * Defines TaskGroup, a set of thunks run on a ThreadPool that can be
+ * waited for (or cancelled) on their own. ThreadPool::wait() waits for
+ * everything anybody scheduled on the pool; TaskGroup::wait() only for
+ * the thunks run through that group, so clients sharing a pool do not
+ * block on each other's work.
+ *
+ * Waiting from inside a thunk running on the same pool does not just
+ * block the worker: it keeps running the pool's queued thunks until the
+ * group is done, so nested fork-join code neither deadlocks nor leaves
+ * workers idle.
+ */
+
+#ifndef _task_group_
+#define _task_group_
+
+#include <atomic>              // for atomic
+#include <condition_variable>  // for condition_variable
+#include <cstddef>             // for size_t
+#include <exception>           // for exception_ptr
+#include <mutex>               // for mutex
+#include <type_traits>         // for decay, is_nothrow_move_constructible
+#include <utility>             // for move, forward
+#include "thread-pool.h"       // for ThreadPool
+
+using namespace std;
+
+class TaskGroup {
+  public:
+
+  /**
+  * Constructs an empty group whose thunks run on pool.
+  */
+    explicit TaskGroup(ThreadPool& pool);
+
+  /**
+  * Schedules fn on the pool as part of this group.
+  */
+    template <typename F>
+    void run(F&& fn) {
+        pending_++;
+        try {
+            pool_.schedule(GroupCall<typename decay<F>::type>(this, forward<F>(fn)));
+        } catch (...) {
+            finishTasks(1);
+            throw;
+        }
+    }
+
+  /**
+  * Schedules fn(0), ..., fn(count - 1) as part of this group, as one
+  * batch (see ThreadPool::schedule_n).
+  */
+    template <typename F>
+    void run_n(size_t count, F&& fn) {
+        pending_ += count;
+        try {
+            pool_.schedule_n(count, IndexedGroupCall<typename decay<F>::type>(this, forward<F>(fn)));
+        } catch (...) {
+            finishTasks(count);
+            throw;
+        }
+    }
+
+  /**
+  * Blocks until every thunk run through this group has finished (or
+  * been skipped by cancel()), helping run the pool's queued thunks if
+  * called from one of its workers. If a thunk threw, the first exception
+  * is rethrown here. Afterwards the group is empty and not cancelled, so
+  * it can be reused.
+  */
+    void wait();
+
+  /**
+  * Makes the group's thunks that have not started yet be skipped.
+  * Thunks already running finish normally; they can poll
+  * is_cancelled() to stop early.
+  */
+    void cancel();
+
+    bool is_cancelled() const { return cancelled_.load(memory_order_relaxed); }
+
+  /**
+  * Waits for the group's thunks like wait(), but without rethrowing.
+  */
+    ~TaskGroup();
+
+  private:
+    template <typename F>
+    class GroupCall {
+      public:
+        template <typename G>
+        GroupCall(TaskGroup *group, G&& fn) : group_(group), fn_(forward<G>(fn)) {}
+        GroupCall(GroupCall&& other) noexcept(is_nothrow_move_constructible<F>::value)
+            : group_(other.group_), fn_(move(other.fn_)) {}
+        void operator()() { group_->invoke(fn_); }
+
+      private:
+        TaskGroup *group_;
+        F fn_;
+    };
+
+    template <typename F>
+    class IndexedGroupCall {
+      public:
+        template <typename G>
+        IndexedGroupCall(TaskGroup *group, G&& fn) : group_(group), fn_(forward<G>(fn)) {}
+        void operator()(size_t index) { group_->invoke(fn_, index); }
+
+      private:
+        TaskGroup *group_;
+        F fn_;
+    };
+
+    template <typename F, typename... A>
+    void invoke(F& fn, A... args) {
+        if (!is_cancelled()) {
+            try {
+                fn(args...);
+            } catch (...) {
+                fail(current_exception());
+            }
+        }
+        finishTasks(1);
+    }
+
+    void fail(exception_ptr error);
+    void finishTasks(size_t count);
+    void waitForTasks();
+
+    ThreadPool& pool_;
+    atomic<size_t> pending_;     // thunks run through the group and not finished
+    atomic<bool> cancelled_;
+    exception_ptr error_;        // first exception a thunk threw
+    mutex mutex_;
+    condition_variable cond_;
+
+    TaskGroup(const TaskGroup& original) = delete;
+    TaskGroup& operator=(const TaskGroup& rhs) = delete;
+};
+
+#endif
@@ -5,40 +5,488 @@
  */
 
 #include "thread-pool.h"
+#include "cpu-relax.h"
 #include <vector>
+#include <stdexcept>
 
 using namespace std;
 
-ThreadPool::ThreadPool(size_t numThreads) 
-    : wts(numThreads), 
+thread_local ThreadPool *ThreadPool::currentPool = nullptr;
+thread_local size_t ThreadPool::currentWorker = 0;
+
+#ifdef THREADPOOL_STATS
+// How many runThunk calls the calling thread is inside of
+static thread_local int runDepth = 0;
+
+static uint64_t statsNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Adds to a counter only the calling thread writes.
+ */
+static void addNanos(atomic<uint64_t>& counter, uint64_t nanos) {
+    counter.store(counter.load(memory_order_relaxed) + nanos, memory_order_relaxed);
+}
+#endif
+
+/**
+ * @brief Small xorshift generator used to pick steal victims.
+ */
+static size_t nextVictimSeed() {
+    static thread_local uint32_t state = 0;
+    if (state == 0) state = (uint32_t)hash<thread::id>()(this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/**
+ * ThunkNodes are cached per thread. Nodes mostly flow one way (allocated
+ * by the thread that schedules, released by the worker that runs them),
+ * so a cache that grows past 2 * kNodeBatch hands kNodeBatch nodes to a
+ * shared list of batches, where an empty cache picks them up again. The
+ * shared list's mutex is taken once per batch, not once per node.
+ */
+static const size_t kNodeBatch = 64;
+
+struct NodeBatches {
+    mutex lock;
+    vector<ThunkNode *> batches;    // each one a list of kNodeBatch nodes
+
+    ~NodeBatches() {
+        for (ThunkNode *batch : batches) {
+            while (batch != nullptr) {
+                ThunkNode *next = batch->next;
+                delete batch;
+                batch = next;
+            }
+        }
+    }
+};
+
+/**
+ * @brief The shared batches of each NUMA node, so nodes released on a
+ * node are reused there (the memory a thread allocates stays close to
+ * it).
+ */
+static NodeBatches& sharedBatches(size_t node) {
+    static vector<NodeBatches> shared(CpuTopology::system().numNodes());
+    return shared[node];
+}
+
+struct NodeCache {
+    ThunkNode *head = nullptr;
+    size_t count = 0;
+
+    ~NodeCache() {
+        // hand everything back so the next thread can use it
+        while (count >= kNodeBatch) spill();
+        while (head != nullptr) {
+            ThunkNode *next = head->next;
+            delete head;
+            head = next;
+        }
+    }
+
+    void spill() {
+        ThunkNode *batch = head;
+        ThunkNode *last = head;
+        for (size_t i = 1; i < kNodeBatch; i++) last = last->next;
+        head = last->next;
+        last->next = nullptr;
+        count -= kNodeBatch;
+        NodeBatches& shared = sharedBatches(CpuTopology::system().currentNode());
+        lock_guard<mutex> lock(shared.lock);
+        shared.batches.push_back(batch);
+    }
+
+  /**
+  * Takes a batch from the calling thread's node, or else from another
+  * node (nodes released on one node and allocated on another would
+  * otherwise pile up).
+  */
+    bool refill() {
+        const CpuTopology& topology = CpuTopology::system();
+        size_t node = topology.currentNode();
+        for (size_t k = 0; k < topology.numNodes(); k++) {
+            NodeBatches& shared = sharedBatches((node + k) % topology.numNodes());
+            lock_guard<mutex> lock(shared.lock);
+            if (shared.batches.empty()) continue;
+            head = shared.batches.back();
+            shared.batches.pop_back();
+            count = kNodeBatch;
+            return true;
+        }
+        return false;
+    }
+};
+
+static thread_local NodeCache nodeCache;
+
+static ThunkNode *acquireNode() {
+    if (nodeCache.head == nullptr && !nodeCache.refill()) {
+        return new ThunkNode();
+    }
+    ThunkNode *node = nodeCache.head;
+    nodeCache.head = node->next;
+    nodeCache.count--;
+    return node;
+}
+
+/**
+ * @brief Destroys the node's callable right away, so its captures are
+ * released when the thunk finishes, and caches the node.
+ */
+static void releaseNode(ThunkNode *node) {
+    node->thunk.reset();
+    node->next = nodeCache.head;
+    nodeCache.head = node;
+    if (++nodeCache.count >= 2 * kNodeBatch) nodeCache.spill();
+}
+
+ThreadPoolOptions ThreadPool::withThreads(size_t numThreads) {
+    ThreadPoolOptions options;
+    options.numThreads = numThreads;
+    return options;
+}
+
+ThreadPool::ThreadPool(size_t numThreads) : ThreadPool(withThreads(numThreads)) {}
+
+/**
+ * @brief How many sets of lanes the pool keeps: one per NUMA node if its
+ * workers are placed, else one.
+ */
+size_t ThreadPool::numLaneNodes(const ThreadPoolOptions& options) {
+    if (options.cpus.empty() && !options.numaAware) return 1;
+    return (options.topology != nullptr ? *options.topology : CpuTopology::system()).numNodes();
+}
+
+void LockedThunkQueue::pushChain(ThunkNode *first, ThunkNode *last, size_t count) {
+    last->next = nullptr;
+    lock_guard<mutex> guard(lock);
+    if (tail != nullptr) {
+        tail->next = first;
+    } else {
+        head = first;
+    }
+    tail = last;
+    size += count;
+}
+
+ThunkNode *LockedThunkQueue::pop() {
+    if (size == 0) return nullptr;
+    lock_guard<mutex> guard(lock);
+    ThunkNode *node = head;
+    if (node != nullptr) {
+        head = node->next;
+        if (head == nullptr) tail = nullptr;
+        size--;
+    }
+    return node;
+}
+
+ThreadPool::ThreadPool(const ThreadPoolOptions& options)
+    : wts(max(max(options.numThreads, options.maxThreads), (size_t)1)),
       done(false),
-      tasksInQueue(0),
-      availableWorkers(numThreads),
+      liveThreads(0),
+      highWater(0),
+      minThreads(options.numThreads > 0 ? options.numThreads : 1),
+      elastic(wts.size() > minThreads),
+      spawnAfter(options.spawnAfter),
+      idleTimeout(options.idleTimeout),
+      backlogSince(0),
+      spawned(0),
+      retired(0),
+      nodeLanes(numLaneNodes(options)),
+      topology(options.topology != nullptr ? *options.topology : CpuTopology::system()),
+      totalWeight(0),
+      laneTicket(0),
+      wakeups(0),
+      idleWorkers(0),
+      spinningWorkers(0),
+      idlePolicy(options.idlePolicy),
+      idleSpin(thread::hardware_concurrency() > 1 ? options.idleSpin : chrono::microseconds(0)),
+      idleYields(options.idlePolicy == ThreadPoolOptions::kParkImmediately ? 0 : options.idleYields),
+      timersClosed(false),
+      timerTick(options.timerTick),
+      queueCapacity(options.queueCapacity),
+      overflowPolicy(options.overflowPolicy),
+      queued(0),
+      queuePeak(0),
+      waitingProducers(0),
+      blockedCount(0),
+      rejectedCount(0),
+      callerRunCount(0),
       pending_tasks(0)
 {
-    for (size_t i = 0; i < numThreads; i++) {
-        wts[i].available = true;
-        wts[i].workReady = new Semaphore(0);
-        wts[i].ts = thread([this, i] { worker(i); });
+    if (options.injectionQueue == ThreadPoolOptions::kLockFreeRing) {
+        ring.reset(new BoundedMPMCQueue<ThunkNode *>(options.ringCapacity));
+    }
+    for (size_t p = 0; p < kNumPriorities; p++) {
+        expired[p] = 0;
+        laneWeights[p] = options.laneWeights[p] > 0 ? options.laneWeights[p] : 1;
+        totalWeight += laneWeights[p];
+    }
+    for (size_t i = 0; i < wts.size(); i++) {
+        if (idlePolicy != ThreadPoolOptions::kParkImmediately) wts[i].spinBudget = idleSpin;
+        if (!options.cpus.empty()) {
+            int cpu = options.cpus[i % options.cpus.size()];
+            wts[i].cpus.push_back(cpu);
+            wts[i].node = topology.nodeOf(cpu);
+        } else if (options.numaAware) {
+            wts[i].node = i % nodeLanes.size();
+            wts[i].cpus = topology.cpusOf(wts[i].node);
+        }
     }
-    dt = thread([this] { dispatcher(); });
+    for (size_t i = 0; i < minThreads; i++) {
+        startWorker(i);
+    }
+}
+
+/**
+ * @brief Starts a thread in the given free slot, first joining the
+ * retired thread that last used it. Called with growLock held (or from
+ * the constructor).
+ */
+void ThreadPool::startWorker(size_t slot) {
+    if (wts[slot].ts.joinable()) wts[slot].ts.join();
+    wts[slot].active = true;
+    liveThreads++;
+    if (highWater <= slot) highWater = slot + 1;
+    wts[slot].ts = thread([this, slot] { worker(slot); });
 }
 
-void ThreadPool::schedule(const function<void(void)>& thunk) {
+/**
+ * @brief Called when thunks are waiting and no worker is idle: starts
+ * the clock on the backlog, or adds a thread if it has lasted longer
+ * than spawnAfter (which restarts the clock, so threads are added at
+ * most once per spawnAfter).
+ */
+void ThreadPool::noteBacklog() {
+    if (liveThreads >= wts.size()) return;
+    chrono::steady_clock::rep now = chrono::steady_clock::now().time_since_epoch().count();
+    chrono::steady_clock::rep since = backlogSince.load();
+    if (since == 0) {
+        backlogSince.compare_exchange_strong(since, now);
+        return;
+    }
+    if (now - since < spawnAfter.count()) return;
+    if (!backlogSince.compare_exchange_strong(since, now)) return;    // someone else spawns
+
+    lock_guard<mutex> lock(growLock);
+    if (done || liveThreads >= wts.size()) return;
+    for (size_t slot = 0; slot < wts.size(); slot++) {
+        if (!wts[slot].active) {
+            startWorker(slot);
+            spawned++;
+            return;
+        }
+    }
+}
+
+ThunkNode *ThreadPool::acquireNodes(size_t count) {
+    ThunkNode *head = nullptr;
+    for (size_t i = 0; i < count; i++) {
+        ThunkNode *node = acquireNode();
+        node->next = head;
+        node->deadline = Deadline::max();
+        head = node;
+    }
+    return head;
+}
+
+void ThreadPool::releaseNodes(ThunkNode *head) {
+    while (head != nullptr) {
+        ThunkNode *next = head->next;
+        releaseNode(head);
+        head = next;
+    }
+}
+
+bool ThreadPool::enqueue(Thunk&& thunk, TaskPriority priority, Deadline deadline,
+                         Admission admission) {
+    ThunkNode *node = acquireNode();
+    node->thunk = move(thunk);
+    node->next = nullptr;
+    node->deadline = deadline;
+    return enqueueChain(node, node, 1, priority, admission);
+}
+
+/**
+ * @brief Queues a chain of count thunks, once the queue has room for
+ * them.
+ *
+ * @return false if the queue was full and admission (or the overflow
+ * policy) says to refuse them, which throws unless admission is kIfRoom.
+ */
+bool ThreadPool::enqueueChain(ThunkNode *head, ThunkNode *tail, size_t count,
+                              TaskPriority priority, Admission admission) {
     if (done) {
+        releaseNodes(head);
         throw logic_error("El ThreadPool ha sido cerrado.");
     }
-    {
-        lock_guard<mutex> lock(wait_mutex);
-        pending_tasks++;
+    if (!admit(count, admission)) {
+        if (admission == kIfRoom || overflowPolicy == ThreadPoolOptions::kRejectWhenFull) {
+            releaseNodes(head);
+            rejectedCount += count;
+            if (admission == kIfRoom) return false;
+            throw runtime_error("La cola del ThreadPool está llena.");
+        }
+        runInCaller(head, priority);
+        return true;
+    }
+    size_t pending = pending_tasks += count;
+    if (queueCapacity == 0) notePeak(pending);
+#ifdef THREADPOOL_STATS
+    uint64_t now = statsNow();
+    for (ThunkNode *node = head; node != nullptr; node = node->next) {
+        node->priority = priority;
+        node->scheduledAt = now;
     }
+#else
+    for (ThunkNode *node = head; node != nullptr; node = node->next) node->priority = priority;
+#endif
 
-    {
-        lock_guard<mutex> lock(queueLock);
-        taskQueue.push(thunk);
+    if (priority != kNormalPriority) {
+        nodeLanes[callerNode()].lanes[priority].pushChain(head, tail, count);
+    } else if (currentPool == this) {
+        WorkStealingDeque<ThunkNode>& local = wts[currentWorker].local;
+        while (head != nullptr) {
+            ThunkNode *next = head->next;
+            local.push(head);
+            head = next;
+        }
+    } else {
+        size_t spilled = count;
+        if (ring) {
+            // whatever does not fit in the ring goes to the linked queue
+            // (read next first: a pushed node may run and be recycled at once)
+            while (head != nullptr) {
+                ThunkNode *next = head->next;
+                if (!ring->tryPush(head)) break;
+                head = next;
+                spilled--;
+            }
+        }
+        if (head != nullptr) nodeLanes[callerNode()].lanes[kNormalPriority].pushChain(head, tail, spilled);
+    }
+
+    wake(count);
+    return true;
+}
+
+/**
+ * @brief Counts count more thunks as queued if the capacity allows it,
+ * waiting for room if the overflow policy says so and the caller is not
+ * one of the pool's threads.
+ *
+ * @return false if the thunks were not let in.
+ */
+bool ThreadPool::admit(size_t count, Admission admission) {
+    if (queueCapacity == 0) return true;
+    if (admission == kAlways) {
+        notePeak(queued += count);
+        return true;
+    }
+    if (tryAdmit(count)) return true;
+    if (admission == kIfRoom || overflowPolicy != ThreadPoolOptions::kBlockWhenFull ||
+        currentPool == this) {
+        return false;
+    }
+
+    // registering before looking again pairs with leaveQueue, which
+    // lowers queued before reading waitingProducers: either this sees
+    // the room or leaveQueue sees this waiting and notifies
+    unique_lock<mutex> lock(roomLock);
+    waitingProducers++;
+    blockedCount++;
+    roomCond.wait(lock, [this, count] { return tryAdmit(count); });
+    waitingProducers--;
+    return true;
+}
+
+/**
+ * @brief Counts count more thunks as queued unless that would go over
+ * the capacity; a batch larger than the capacity fits only an empty
+ * queue, or it would never fit.
+ */
+bool ThreadPool::tryAdmit(size_t count) {
+    size_t depth = queued.load();
+    do {
+        if (depth > 0 && depth + count > queueCapacity) return false;
+    } while (!queued.compare_exchange_weak(depth, depth + count));
+    notePeak(depth + count);
+    return true;
+}
+
+void ThreadPool::notePeak(size_t depth) {
+    size_t peak = queuePeak.load(memory_order_relaxed);
+    while (depth > peak && !queuePeak.compare_exchange_weak(peak, depth, memory_order_relaxed)) {}
+}
+
+/**
+ * @brief Called as a thunk is taken to run: it no longer takes up room
+ * in the queue, so a scheduler waiting for room may go ahead.
+ */
+void ThreadPool::leaveQueue() {
+    if (queueCapacity == 0) return;
+    queued--;
+    if (waitingProducers > 0) {
+        lock_guard<mutex> lock(roomLock);
+        roomCond.notify_all();
+    }
+}
+
+/**
+ * @brief Runs thunks the queue had no room for on the calling thread,
+ * dropping the ones whose deadline has passed. If one throws, the rest
+ * are destroyed without running and the exception reaches the caller.
+ */
+void ThreadPool::runInCaller(ThunkNode *head, TaskPriority priority) {
+    while (head != nullptr) {
+        ThunkNode *next = head->next;
+        callerRunCount++;
+        try {
+            if (head->deadline != Deadline::max() && chrono::steady_clock::now() > head->deadline) {
+                expired[priority]++;
+            } else {
+                head->thunk();
+            }
+        } catch (...) {
+            releaseNode(head);
+            releaseNodes(next);
+            throw;
+        }
+        releaseNode(head);
+        head = next;
+    }
+}
+
+TimerId ThreadPool::addTimer(chrono::steady_clock::duration delay,
+                             chrono::steady_clock::duration period, Thunk&& thunk) {
+    lock_guard<mutex> lock(timersLock);
+    // the destructor drops pending timers; ones added after that, by
+    // the thunks it waits for, are dropped too
+    if (timersClosed) return 0;
+    if (!timers) {
+        timers.reset(new TimerWheel(timerTick, [this](Thunk&& due) {
+            enqueue(move(due), kNormalPriority, Deadline::max(), kAlways);
+        }));
     }
-    
-    tasksInQueue.signal();
+    return timers->add(delay, period, move(thunk));
+}
+
+bool ThreadPool::cancel_timer(TimerId timer) {
+    lock_guard<mutex> lock(timersLock);
+    return timers && timers->cancel(timer);
+}
+
+size_t ThreadPool::pending_timers() const {
+    lock_guard<mutex> lock(timersLock);
+    return timers ? timers->size() : 0;
 }
 
 void ThreadPool::wait() {
@@ -47,75 +495,390 @@ void ThreadPool::wait() {
 }
 
 ThreadPool::~ThreadPool() {
+    // stop the timer thread first, so nothing is queued after wait()
+    unique_ptr<TimerWheel> wheel;
+    {
+        lock_guard<mutex> lock(timersLock);
+        timersClosed = true;
+        wheel = move(timers);
+    }
+    wheel.reset();
     wait();
 
-    done = true;
-
-    tasksInQueue.signal(); 
-    for (size_t i = 0; i < wts.size(); ++i) {
-        availableWorkers.signal();
-        wts[i].workReady->signal();
+    {
+        // no thread is started after this
+        lock_guard<mutex> lock(growLock);
+        done = true;
     }
 
-    if (dt.joinable()) dt.join();
+    // one wakeup per worker; there is no work left, so each of them exits
+    wakeups.signal(wts.size());
+
     for (auto& worker : wts) {
         if (worker.ts.joinable()) worker.ts.join();
-        delete worker.workReady;
     }
 }
 
-void ThreadPool::dispatcher() {
-    while (!done) {
-        tasksInQueue.wait();
-        if (done) break;
+/**
+ * @brief Takes up to count workers off counter in a single update.
+ *
+ * @return How many were taken.
+ */
+static int claimWorkers(atomic<int>& counter, size_t count) {
+    int available = counter.load();
+    while (available > 0) {
+        int claimed = (size_t)available < count ? available : (int)count;
+        if (counter.compare_exchange_weak(available, available - claimed)) return claimed;
+    }
+    return 0;
+}
 
-        availableWorkers.wait();
-        if (done) break;
+/**
+ * @brief Takes one idle worker off idleWorkers, if there is any left.
+ *
+ * @return true if the caller now owes (or is owed) one wakeup.
+ */
+static bool claimIdle(atomic<int>& idleWorkers) {
+    return claimWorkers(idleWorkers, 1) == 1;
+}
 
-        function<void(void)> task;
-        {
-            lock_guard<mutex> lock(queueLock);
-            if (taskQueue.empty()) {
-                 availableWorkers.signal();
-                 continue;
-            }
-            task = taskQueue.front();
-            taskQueue.pop();
+/**
+ * @brief Wakes up to count sleeping workers after count thunks were
+ * queued. Spinning workers are claimed first, one per thunk, since they
+ * will find the thunks without a wakeup; only the rest of the count
+ * goes to sleeping workers, all claimed with a single update of
+ * idleWorkers.
+ *
+ * The fence pairs with the one a worker issues after registering itself
+ * in idleWorkers (or leaving spinningWorkers) and before looking for
+ * work one last time: either the worker sees the new thunks or this
+ * sees the worker and wakes it.
+ */
+void ThreadPool::wake(size_t count) {
+    atomic_thread_fence(memory_order_seq_cst);
+    count -= claimWorkers(spinningWorkers, count);
+    if (count == 0) return;
+    int claimed = claimWorkers(idleWorkers, count);
+    if (claimed > 0) wakeups.signal(claimed);
+    if (elastic && (size_t)claimed < count) noteBacklog();
+}
+
+/**
+ * @brief Steals from the other workers, starting at a random victim.
+ */
+ThunkNode *ThreadPool::stealThunk(size_t id) {
+    size_t n = highWater;
+    size_t start = nextVictimSeed() % n;
+    // with several nodes, a worker tries the workers of its own node first
+    bool numa = nodeLanes.size() > 1 && id < wts.size();
+    for (int pass = numa ? 0 : 1; pass < 2; pass++) {
+        for (size_t k = 0; k < n; k++) {
+            size_t victim = (start + k) % n;
+            if (victim == id) continue;
+            if (numa && (wts[victim].node == wts[id].node) != (pass == 0)) continue;
+            ThunkNode *thunk = wts[victim].local.steal();
+            if (thunk != nullptr) return thunk;
         }
+    }
+    return nullptr;
+}
 
-        for (size_t i = 0; i < wts.size(); i++) {
-            wts[i].workerMutex.lock();
-            if (wts[i].available) {
-                wts[i].available = false;
-                wts[i].thunk = task;
-                wts[i].workerMutex.unlock();
-                wts[i].workReady->signal();
-                break; 
-            }
-            wts[i].workerMutex.unlock();
+/**
+ * @brief The NUMA node whose lanes the calling thread uses.
+ */
+size_t ThreadPool::callerNode() const {
+    if (nodeLanes.size() == 1) return 0;
+    if (currentPool == this) return wts[currentWorker].node;
+    return topology.currentNode() % nodeLanes.size();
+}
+
+size_t ThreadPool::laneDepth(size_t lane) const {
+    size_t depth = 0;
+    for (const NodeLanes& node : nodeLanes) depth += node.lanes[lane].size;
+    return depth;
+}
+
+/**
+ * @brief Takes a thunk from the given lane, trying the given node's
+ * queue first and then the other nodes'.
+ */
+ThunkNode *ThreadPool::popLane(size_t lane, size_t node) {
+    ThunkNode *thunk;
+    if (lane == kNormalPriority && ring && ring->tryPop(thunk)) return thunk;
+    size_t numNodes = nodeLanes.size();
+    for (size_t k = 0; k < numNodes; k++) {
+        thunk = nodeLanes[(node + k) % numNodes].lanes[lane].pop();
+        if (thunk != nullptr) return thunk;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Takes the next thunk from the priority lanes. While only the
+ * normal lane is in use, that is all it looks at; otherwise a ticket
+ * picks the lane to try first, each lane owning a share of the tickets
+ * proportional to its weight, and the rest are tried by priority.
+ * Each lane is looked up on the given node first.
+ */
+ThunkNode *ThreadPool::popLanes(size_t node) {
+    if (laneDepth(kHighPriority) == 0 && laneDepth(kLowPriority) == 0) {
+        return popLane(kNormalPriority, node);
+    }
+
+    size_t ticket = laneTicket.fetch_add(1, memory_order_relaxed) % totalWeight;
+    size_t first = 0;
+    while (ticket >= laneWeights[first]) ticket -= laneWeights[first++];
+    ThunkNode *thunk = popLane(first, node);
+    for (size_t lane = 0; thunk == nullptr && lane < kNumPriorities; lane++) {
+        if (lane != first) thunk = popLane(lane, node);
+    }
+    return thunk;
+}
+
+/**
+ * @brief Looks for work: the worker's own deque first, then the
+ * priority lanes, then the other workers' deques. Threads outside the
+ * pool pass wts.size() as id.
+ */
+ThunkNode *ThreadPool::findThunk(size_t id) {
+    ThunkNode *thunk = id < wts.size() ? wts[id].local.pop() : nullptr;
+    if (thunk != nullptr) return thunk;
+
+    thunk = popLanes(id < wts.size() ? wts[id].node : callerNode());
+    if (thunk != nullptr) return thunk;
+
+    return stealThunk(id);
+}
+
+PoolStats ThreadPool::stats() const {
+    PoolStats stats;
+#ifdef THREADPOOL_STATS
+    stats.enabled = true;
+    stats.workers.resize(wts.size());
+    uint64_t now = statsNow();
+    for (size_t i = 0; i < wts.size(); i++) {
+        stats.add(wts[i].stats, &stats.workers[i]);
+        // count the idle spell a worker is in, too
+        uint64_t since = wts[i].stats.idleSince.load(memory_order_relaxed);
+        if (since != 0 && now > since) stats.workers[i].idle += now - since;
+    }
+    lock_guard<mutex> lock(outsideStatsLock);
+    stats.add(outsideStats, nullptr);
+#endif
+    return stats;
+}
+
+LaneStats ThreadPool::lane_stats(TaskPriority priority) const {
+    LaneStats stats;
+    stats.depth = laneDepth(priority);
+    if (priority == kNormalPriority && ring) stats.depth += ring->sizeApprox();
+    stats.expired = expired[priority];
+    return stats;
+}
+
+QueueStats ThreadPool::queue_stats() const {
+    QueueStats stats;
+    stats.depth = queueCapacity > 0 ? queued.load() : pending_tasks.load();
+    stats.capacity = queueCapacity;
+    stats.highWater = queuePeak;
+    stats.blocked = blockedCount;
+    stats.rejected = rejectedCount;
+    stats.ranInCaller = callerRunCount;
+    return stats;
+}
+
+void ThreadPool::finishThunk() {
+    if (pending_tasks.fetch_sub(1) == 1) {
+        lock_guard<mutex> lock(wait_mutex);
+        wait_cond.notify_all();
+    }
+}
+
+/**
+ * @brief Runs the thunk, unless it carries a deadline that has passed,
+ * in which case it is only counted as expired.
+ */
+void ThreadPool::runThunk(ThunkNode *thunk) {
+    leaveQueue();
+#ifdef THREADPOOL_STATS
+    uint64_t depth = pending_tasks;
+    uint64_t startedAt = statsNow();
+    runDepth++;
+#endif
+    if (thunk->deadline != Deadline::max() && chrono::steady_clock::now() > thunk->deadline) {
+        expired[thunk->priority]++;
+    } else {
+        thunk->thunk();
+    }
+#ifdef THREADPOOL_STATS
+    runDepth--;
+    recordRun(thunk, depth, startedAt, statsNow());
+#endif
+    releaseNode(thunk);
+    finishThunk();
+}
+
+#ifdef THREADPOOL_STATS
+/**
+ * @brief Records a thunk the calling thread ran: into its worker's
+ * stats, which only it writes, or into outsideStats under a lock if it
+ * is not a worker. A thunk run while another one waits (helping a
+ * TaskGroup) adds to the run time histogram but not to busy time, which
+ * the outer thunk already covers.
+ */
+void ThreadPool::recordRun(const ThunkNode *thunk, uint64_t depth, uint64_t startedAt,
+                           uint64_t endedAt) {
+    bool outside = currentPool != this;
+    unique_lock<mutex> lock(outsideStatsLock, defer_lock);
+    if (outside) lock.lock();
+    WorkerStats& stats = outside ? outsideStats : wts[currentWorker].stats;
+    stats.queueLatency.record(startedAt > thunk->scheduledAt ? startedAt - thunk->scheduledAt : 0);
+    stats.runTime.record(endedAt - startedAt);
+    stats.queueDepth.record(depth);
+    if (runDepth == 0) addNanos(stats.busy, endedAt - startedAt);
+}
+
+void ThreadPool::beginIdle(size_t id) {
+    wts[id].stats.idleSince.store(statsNow(), memory_order_relaxed);
+}
+
+void ThreadPool::endIdle(size_t id) {
+    WorkerStats& stats = wts[id].stats;
+    uint64_t since = stats.idleSince.load(memory_order_relaxed);
+    if (since == 0) return;
+    addNanos(stats.idle, statsNow() - since);
+    stats.idleSince.store(0, memory_order_relaxed);
+}
+#endif
+
+bool ThreadPool::run_pending_task() {
+    ThunkNode *thunk = findThunk(currentPool == this ? currentWorker : wts.size());
+    if (thunk == nullptr) return false;
+    runThunk(thunk);
+    return true;
+}
+
+/**
+ * @brief Sleeps until woken. A worker above the minimum count sleeps
+ * for idleTimeout at most, and then retires unless a wakeup was posted
+ * for it in the meantime.
+ *
+ * @return false if the worker has to exit.
+ */
+bool ThreadPool::sleep(size_t id) {
+    if (liveThreads <= minThreads) {
+        wakeups.wait();
+        return !done;
+    }
+    if (wakeups.wait_for(idleTimeout)) return !done;
+    // timed out: withdraw from idleWorkers, or absorb the wakeup a
+    // scheduler posted on our behalf in the meantime
+    if (!claimIdle(idleWorkers)) {
+        wakeups.wait();
+        return !done;
+    }
+    size_t live = liveThreads;
+    while (live > minThreads) {
+        if (liveThreads.compare_exchange_weak(live, live - 1)) {
+            retired++;
+            wts[id].active = false;
+            return false;
         }
     }
+    return true;    // others retired first; look for work again
 }
 
-void ThreadPool::worker(int id) {
-    while (!done) {
-        wts[id].workReady->wait();
-        if (done) break;
+/**
+ * @brief The spinning and yielding phases of the idle policy: looks for
+ * work, pausing between looks, for up to the worker's spin budget, then
+ * yields the CPU idleYields times, looking after each.
+ */
+ThunkNode *ThreadPool::spinForThunk(size_t id) {
+    static const int kChecksPerClockRead = 16;
+    chrono::steady_clock::duration budget = wts[id].spinBudget;
+    if (budget.count() == 0 && idleYields == 0) return nullptr;
 
-        wts[id].thunk();
-        
-        {
-            lock_guard<mutex> lock(wts[id].workerMutex);
-            wts[id].available = true;
+    spinningWorkers++;
+    ThunkNode *thunk = nullptr;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    chrono::steady_clock::duration spun(0);
+    while (thunk == nullptr && spun < budget) {
+        for (int i = 0; thunk == nullptr && i < kChecksPerClockRead; i++) {
+            cpuRelax();
+            thunk = findThunk(id);
         }
-        availableWorkers.signal();
+        spun = chrono::steady_clock::now() - start;
+    }
+    for (unsigned i = 0; thunk == nullptr && i < idleYields; i++) {
+        this_thread::yield();
+        thunk = findThunk(id);
+    }
+    // if a scheduler claimed us, its thunk is found by the next look
+    claimWorkers(spinningWorkers, 1);
 
-        {
-            lock_guard<mutex> lock(wait_mutex);
-            pending_tasks--;
-            if (pending_tasks == 0) {
-                wait_cond.notify_all();
+    if (idlePolicy == ThreadPoolOptions::kAdaptiveSpin) {
+        adaptSpin(id, thunk != nullptr ? chrono::steady_clock::now() - start : idleSpin + idleSpin);
+    }
+    return thunk;
+}
+
+/**
+ * @brief Adapts an adaptive worker's spin budget to how long it was idle
+ * before work arrived: twice that long if it is within idleSpin (so
+ * spinning would have caught it), else half the current budget.
+ */
+void ThreadPool::adaptSpin(size_t id, chrono::steady_clock::duration idleFor) {
+    chrono::steady_clock::duration& budget = wts[id].spinBudget;
+    if (idleFor < idleSpin) {
+        budget = max(budget, 2 * idleFor);
+        if (budget > idleSpin) budget = idleSpin;
+    } else {
+        budget /= 2;
+    }
+}
+
+void ThreadPool::worker(size_t id) {
+    currentPool = this;
+    currentWorker = id;
+    if (!wts[id].cpus.empty()) pinCurrentThread(wts[id].cpus);
+
+    while (true) {
+        ThunkNode *thunk = findThunk(id);
+        chrono::steady_clock::time_point idleSince;
+        if (thunk == nullptr) {
+            if (elastic && backlogSince != 0) backlogSince = 0;
+            if (idlePolicy == ThreadPoolOptions::kAdaptiveSpin) idleSince = chrono::steady_clock::now();
+#ifdef THREADPOOL_STATS
+            beginIdle(id);
+#endif
+            thunk = spinForThunk(id);
+        }
+        if (thunk == nullptr) {
+            // register as idle, then look once more so a thunk queued in
+            // between is not missed
+            idleWorkers++;
+            atomic_thread_fence(memory_order_seq_cst);
+            thunk = findThunk(id);
+            if (thunk == nullptr) {
+                bool keepGoing = sleep(id);
+#ifdef THREADPOOL_STATS
+                endIdle(id);
+#endif
+                if (!keepGoing) break;
+                if (idlePolicy == ThreadPoolOptions::kAdaptiveSpin) {
+                    adaptSpin(id, chrono::steady_clock::now() - idleSince);
+                }
+                continue;
             }
+            // found work after all: withdraw, or absorb the wakeup a
+            // scheduler already posted on our behalf
+            if (!claimIdle(idleWorkers)) wakeups.wait();
         }
+#ifdef THREADPOOL_STATS
+        endIdle(id);
+#endif
+
+        runThunk(thunk);
+        if (elastic && backlogSince != 0 && idleWorkers == 0) noteBacklog();
     }
 }
@@ -3,42 +3,278 @@
  * -------------------
  * This class defines the ThreadPool class, which accepts a collection
  * of thunks (which are zero-argument functions that don't return a value)
- * and schedules them in a FIFO manner to be executed by a constant number
- * of child threads that exist solely to invoke previously scheduled thunks.
+ * and schedules them to be executed by a constant number of child threads
+ * that exist solely to invoke previously scheduled thunks.
+ *
+ * Thunks scheduled from outside the pool go to a shared injection queue
+ * and are started in FIFO order. Thunks scheduled by a thunk that is
+ * already running on one of the pool's threads go to that thread's own
+ * deque, which it works through newest first; idle threads steal the
+ * oldest thunks from the other threads' deques.
+ *
+ * The injection queue is a mutex-protected linked list by default; the
+ * pool can instead be built with a lock-free bounded ring (see
+ * ThreadPoolOptions), in which case the locked queue only takes the
+ * overflow when the ring is full.
+ *
+ * Thunks can also be scheduled with a TaskPriority. Each priority has
+ * its own FIFO lane (the normal one is the injection queue above), and
+ * workers pick the lane to serve next by weighted round robin, falling
+ * back to the other lanes when it is empty, so urgent thunks overtake
+ * queued batch work without starving it. A thunk can also carry a
+ * deadline, past which it is dropped instead of run.
+ *
+ * A pool built with ThreadPoolOptions::maxThreads above numThreads is
+ * elastic: it adds threads, up to maxThreads, while thunks keep waiting
+ * with no idle thread to take them, and retires the extra threads once
+ * they have been idle for a while.
+ *
+ * Workers can be pinned to CPUs (ThreadPoolOptions::cpus) or spread over
+ * the machine's NUMA nodes (numaAware). Either way each worker belongs
+ * to a node, every node gets its own set of lanes (thunks scheduled from
+ * a CPU of node k go to node k's lanes, and workers serve their own
+ * node's lanes first), and idle workers steal from workers of their own
+ * node before crossing to other nodes.
+ *
+ * A worker that runs out of work does not go to sleep right away: by
+ * default it keeps looking for a while (spinning, then yielding the
+ * CPU), so thunks that arrive shortly after are picked up without a
+ * kernel wakeup. How long it spins adapts to how soon work has been
+ * arriving (see ThreadPoolOptions::idlePolicy).
+ *
+ * Thunks can also be scheduled to run after a delay, or periodically
+ * (schedule_after, schedule_every). They wait in a TimerWheel serviced
+ * by one timer thread, started with the first timer, which queues them
+ * for the workers once they are due.
+ *
+ * The queue is unbounded by default. With
+ * ThreadPoolOptions::queueCapacity set, at most that many thunks wait to
+ * be started, and a scheduler that finds the queue full waits for room,
+ * gets an exception or runs the thunk itself (overflowPolicy), so a
+ * producer faster than the workers cannot make the pool's memory grow
+ * without bound; try_schedule refuses the thunk instead.
+ *
+ * Built with THREADPOOL_STATS defined, the pool also measures how long
+ * thunks wait and run, how deep the backlog is and how busy each worker
+ * is (see stats()). Without it none of that is compiled in.
  */
 
 #ifndef _thread_pool_
 #define _thread_pool_
 
 #include <cstddef>     // for size_t
-#include <functional>  // for the function template used in the schedule signature
+#include <functional>  // for function
+#include <utility>     // for forward
+#include <iterator>    // for distance
 #include <thread>      // for thread
 #include <vector>      // for vector
-#include <queue>       // for queue
 #include <atomic>      // for atomic
+#include <chrono>      // for steady_clock
 #include <mutex>       // for mutex
 #include <condition_variable> // for condition_variable
+#include <memory>      // for unique_ptr
+#include <stdexcept>   // for invalid_argument, runtime_error
 #include "Semaphore.h" // for Semaphore
+#include "cpu-topology.h" // for CpuTopology
+#include "thunk.h"     // for Thunk
+#include "future.h"    // for Future
+#include "work-stealing-deque.h" // for WorkStealingDeque
+#include "mpmc-queue.h" // for BoundedMPMCQueue
+#include "pool-stats.h" // for PoolStats, WorkerStats
+#include "timer-wheel.h" // for TimerWheel, TimerId
 
 using namespace std;
 
+/**
+ * @brief The lanes thunks scheduled with a priority wait in.
+ */
+enum TaskPriority {
+    kHighPriority,
+    kNormalPriority,    // schedule() without a priority
+    kLowPriority,
+    kNumPriorities
+};
+
+typedef chrono::steady_clock::time_point Deadline;
+
+/**
+ * @brief A scheduled thunk as it travels through the pool's queues.
+ *
+ * Nodes are recycled through per-thread caches, so once a program has
+ * warmed up, scheduling a thunk whose captures fit in Thunk's inline
+ * buffer does not allocate at all.
+ */
+struct ThunkNode {
+    Thunk thunk;
+    ThunkNode *next;         // link in a lane or in a node cache
+    Deadline deadline;       // Deadline::max() if it has none
+    TaskPriority priority;
+#ifdef THREADPOOL_STATS
+    uint64_t scheduledAt;    // nanoseconds, on the stats clock
+#endif
+};
+
+/**
+ * @brief A FIFO of ThunkNodes behind a mutex, whose length can be read
+ * without taking it.
+ */
+struct LockedThunkQueue {
+    ThunkNode *head = nullptr;    // linked through ThunkNode::next
+    ThunkNode *tail = nullptr;
+    mutex lock;
+    atomic<size_t> size{0};
+
+    void pushChain(ThunkNode *first, ThunkNode *last, size_t count);
+    ThunkNode *pop();
+};
+
+/**
+ * @brief The lanes of one NUMA node, one per priority.
+ */
+struct NodeLanes {
+    LockedThunkQueue lanes[kNumPriorities];
+};
+
 /**
  * @brief Represents a worker in the thread pool.
- * 
- * The `worker_t` struct contains information about a worker 
- * thread in the thread pool. Should be includes the thread object, 
- * availability status, the task to be executed, and a semaphore 
- * (or condition variable) to signal when work is ready for the 
- * worker to process.
+ *
+ * Besides its thread handle, each worker owns the deque that receives
+ * the thunks scheduled from inside the thunks it runs.
  */
 typedef struct worker {
-    thread ts;                     // Thread handle
-    function<void(void)> thunk;    // Current task to execute
-    bool available;                // Indicates if worker is available
-    Semaphore* workReady;          // Signals when work is ready for this specific worker
-    mutex workerMutex;             // Protects worker state
+    thread ts;                          // Thread handle
+    WorkStealingDeque<ThunkNode> local; // Thunks scheduled by this worker
+    atomic<bool> active{false};         // a thread is running in this slot
+    vector<int> cpus;                   // CPUs it is pinned to, if any
+    size_t node = 0;                    // its NUMA node (index in nodeLanes)
+    chrono::steady_clock::duration spinBudget{0}; // how long it spins when idle
+#ifdef THREADPOOL_STATS
+    WorkerStats stats;                  // recorded by the thread in this slot
+#endif
 } worker_t;
 
+/**
+ * @brief Construction-time settings of a ThreadPool.
+ */
+struct ThreadPoolOptions {
+    enum QueueKind {
+        kLockedQueue,      // linked list behind a mutex
+        kLockFreeRing      // BoundedMPMCQueue, spilling to the locked queue when full
+    };
+
+    size_t numThreads = thread::hardware_concurrency();
+    QueueKind injectionQueue = kLockedQueue;
+    size_t ringCapacity = 4096;
+
+    // Out of every sum-of-weights picks made while all lanes have work,
+    // lane p is served laneWeights[p] times (a weight of 0 counts as 1)
+    unsigned laneWeights[kNumPriorities] = {8, 4, 1};
+
+    // Elastic pools: numThreads is the minimum; when maxThreads is
+    // larger, a thread is added each time thunks have waited spawnAfter
+    // with no idle thread, and an extra thread idle for idleTimeout exits
+    size_t maxThreads = 0;
+    chrono::microseconds spawnAfter = chrono::milliseconds(1);
+    chrono::microseconds idleTimeout = chrono::seconds(1);
+
+    // Placement: worker i is pinned to cpus[i % cpus.size()]; without a
+    // CPU list, numaAware spreads the workers round robin over the NUMA
+    // nodes, each pinned to its node's CPUs. With neither, the OS places
+    // the workers and the pool treats the machine as a single node
+    vector<int> cpus;
+    bool numaAware = false;
+    const CpuTopology *topology = nullptr;    // the machine's, if null
+
+    // Idle workers: kSpinThenPark looks for work for idleSpin (pausing
+    // between looks), then yields the CPU idleYields times, then sleeps;
+    // kAdaptiveSpin spins for a budget between 0 and idleSpin that grows
+    // when work arrived soon after the worker went idle and shrinks when
+    // it did not; kParkImmediately sleeps right away. There is no
+    // spinning on single-CPU machines, only yielding
+    enum IdlePolicy {
+        kParkImmediately,
+        kSpinThenPark,
+        kAdaptiveSpin
+    };
+    IdlePolicy idlePolicy = kAdaptiveSpin;
+    chrono::microseconds idleSpin = chrono::microseconds(50);
+    unsigned idleYields = 8;
+
+    // Granularity of schedule_after and schedule_every: delays are
+    // rounded up to a whole number of ticks
+    chrono::microseconds timerTick = chrono::milliseconds(1);
+
+    // Backpressure: with queueCapacity above 0, at most that many thunks
+    // wait to be started (a batch larger than that is let in only when
+    // none wait). A scheduler that finds the queue full waits for room
+    // (kBlockWhenFull), gets a runtime_error (kRejectWhenFull) or runs
+    // the thunks itself (kRunInCaller). A running thunk never waits: it
+    // would hold a worker that could be making the room, so under
+    // kBlockWhenFull it runs what it schedules instead. Due timers are
+    // always let in, so the timer thread never waits either, and so are
+    // coroutines moving to the pool with co_await schedule()
+    enum OverflowPolicy {
+        kBlockWhenFull,
+        kRejectWhenFull,
+        kRunInCaller
+    };
+    size_t queueCapacity = 0;
+    OverflowPolicy overflowPolicy = kBlockWhenFull;
+};
+
+/**
+ * @brief What lane_stats reports about one priority lane.
+ */
+struct LaneStats {
+    size_t depth;       // thunks waiting in the lane
+    size_t expired;     // thunks dropped because their deadline passed
+};
+
+/**
+ * @brief What queue_stats reports about the thunks waiting to start.
+ */
+struct QueueStats {
+    size_t depth;       // thunks scheduled and not started (not finished, if unbounded)
+    size_t capacity;    // queueCapacity, 0 if unbounded
+    size_t highWater;   // the largest depth seen
+    size_t blocked;     // times a scheduler waited for room
+    size_t rejected;    // thunks refused for lack of room
+    size_t ranInCaller; // thunks run by their scheduler for lack of room
+};
+
+/**
+ * @brief The callable schedule_n shares among the thunks of a batch;
+ * the last of them to be destroyed deletes it.
+ */
+template <typename F>
+struct IndexedBatch {
+    template <typename G>
+    IndexedBatch(G&& fn, size_t count) : fn(forward<G>(fn)), remaining(count) {}
+    F fn;
+    atomic<size_t> remaining;
+};
+
+/**
+ * @brief One thunk of a schedule_n batch: calls the shared callable
+ * with its index.
+ */
+template <typename F>
+class IndexedCall {
+  public:
+    IndexedCall(IndexedBatch<F> *batch, size_t index) : batch_(batch), index_(index) {}
+    IndexedCall(IndexedCall&& other) noexcept : batch_(other.batch_), index_(other.index_) {
+        other.batch_ = nullptr;
+    }
+    ~IndexedCall() {
+        if (batch_ != nullptr && batch_->remaining.fetch_sub(1) == 1) delete batch_;
+    }
+    void operator()() { batch_->fn(index_); }
+
+  private:
+    IndexedBatch<F> *batch_;
+    size_t index_;
+};
+
 class ThreadPool {
   public:
 
@@ -48,13 +284,186 @@ class ThreadPool {
   */
     ThreadPool(size_t numThreads);
 
+  /**
+  * Constructs a ThreadPool with the given options.
+  */
+    ThreadPool(const ThreadPoolOptions& options);
+
   /**
   * Schedules the provided thunk (which is something that can
   * be invoked as a zero-argument function without a return value)
-  * to be executed by one of the ThreadPool's threads as soon as
-  * all previously scheduled thunks have been handled.
+  * to be executed by one of the ThreadPool's threads. Called from
+  * outside the pool, the thunk runs after all previously scheduled
+  * outside thunks have started; called from a running thunk, it is
+  * queued on the calling worker, where other workers may steal it.
+  *
+  * The thunk is moved (or, for an lvalue, copied once) into a Thunk
+  * and moved from there on. If the pool has a queueCapacity and the
+  * queue is full, what happens depends on its overflowPolicy.
+  */
+    template <typename F>
+    void schedule(F&& thunk) {
+        enqueue(Thunk(forward<F>(thunk)));
+    }
+
+  /**
+  * Schedules the thunk in the given priority's lane, from where it is
+  * started in FIFO order with the lane's other thunks (even when called
+  * from a running thunk). If a deadline is given and it has passed by
+  * the time a worker takes the thunk, the thunk is destroyed without
+  * being run and counted in lane_stats(priority).expired.
+  */
+    template <typename F>
+    void schedule(F&& thunk, TaskPriority priority, Deadline deadline = Deadline::max()) {
+        enqueue(Thunk(forward<F>(thunk)), priority, deadline);
+    }
+
+  /**
+  * Schedules the thunk like schedule() would, unless the pool has a
+  * queueCapacity and the queue is full, whatever the overflowPolicy.
+  *
+  * @return false if the queue was full; the thunk was then destroyed
+  * without running.
+  */
+    template <typename F>
+    bool try_schedule(F&& thunk) {
+        return enqueue(Thunk(forward<F>(thunk)), kNormalPriority, Deadline::max(), kIfRoom);
+    }
+
+    template <typename F>
+    bool try_schedule(F&& thunk, TaskPriority priority, Deadline deadline = Deadline::max()) {
+        return enqueue(Thunk(forward<F>(thunk)), priority, deadline, kIfRoom);
+    }
+
+  /**
+  * What schedule() returns: awaited in a C++20 coroutine, it suspends
+  * the coroutine and resumes it on one of the pool's threads. The resume
+  * is queued even if the queue is full (a suspended coroutine holds its
+  * frame anyway), so the overflow policy never runs it inline or throws.
+  */
+    class ScheduleAwaiter {
+      public:
+        explicit ScheduleAwaiter(ThreadPool *pool) : pool_(pool) {}
+        bool await_ready() const noexcept { return false; }
+        template <typename Handle>
+        void await_suspend(Handle coroutine) {
+            pool_->enqueue(Thunk([coroutine]() mutable { coroutine.resume(); }), kNormalPriority,
+                           Deadline::max(), kAlways);
+        }
+        void await_resume() const noexcept {}
+
+      private:
+        ThreadPool *pool_;
+    };
+
+  /**
+  * For coroutines: `co_await pool.schedule();` moves the rest of the
+  * coroutine onto the pool (see coroutine.h).
+  */
+    ScheduleAwaiter schedule() { return ScheduleAwaiter(this); }
+
+  /**
+  * Schedules every thunk in [begin, end) (copied, unless the iterators
+  * are move_iterators) as one batch: the whole batch is queued under a
+  * single lock acquisition, pending thunks are counted once and exactly
+  * min(batch size, idle workers) threads are woken.
+  */
+    template <typename Iterator>
+    void schedule_bulk(Iterator begin, Iterator end) {
+        size_t count = distance(begin, end);
+        if (count == 0) return;
+        ThunkNode *head = acquireNodes(count), *tail = head;
+        try {
+            for (ThunkNode *node = head; node != nullptr; node = node->next, ++begin) {
+                node->thunk = Thunk(*begin);
+                tail = node;
+            }
+        } catch (...) {
+            releaseNodes(head);
+            throw;
+        }
+        enqueueChain(head, tail, count);
+    }
+
+  /**
+  * Schedules fn(0), fn(1), ..., fn(count - 1) as one batch, like
+  * schedule_bulk. fn is stored once and shared by the batch's thunks.
+  */
+    template <typename F>
+    void schedule_n(size_t count, F&& fn) {
+        if (count == 0) return;
+        IndexedBatch<typename decay<F>::type> *batch =
+            new IndexedBatch<typename decay<F>::type>(forward<F>(fn), count);
+        ThunkNode *head = acquireNodes(count), *tail = head;
+        size_t index = 0;
+        for (ThunkNode *node = head; node != nullptr; node = node->next) {
+            node->thunk = Thunk(IndexedCall<typename decay<F>::type>(batch, index++));
+            tail = node;
+        }
+        enqueueChain(head, tail, count);
+    }
+
+  /**
+  * Schedules fn(args...) like schedule() does and returns a Future for
+  * its result, so callers can wait for exactly the results they need.
+  * The arguments are stored by value and passed to fn as rvalues; an
+  * exception thrown by fn is rethrown by Future::get.
+  */
+    template <typename F, typename... Args>
+    auto submit(F&& fn, Args&&... args)
+        -> Future<typename CallResult<typename decay<F>::type, typename decay<Args>::type...>::type> {
+        typedef typename CallResult<typename decay<F>::type, typename decay<Args>::type...>::type R;
+        typedef SubmittedCall<R, typename decay<F>::type, typename decay<Args>::type...> Call;
+
+        FutureState<typename Future<R>::value_type> *state =
+            new FutureState<typename Future<R>::value_type>();
+        Future<R> result(state);
+        schedule(Call(state, forward<F>(fn), forward<Args>(args)...));
+        return result;
+    }
+
+  /**
+  * Schedules thunk to run once delay has passed (rounded up to the
+  * timer tick). No worker is held while it waits, and wait() does not
+  * wait for it until it is due.
+  *
+  * @return An id to cancel it with, or 0 if the pool is being destroyed
+  * (and the timer was dropped).
+  */
+    template <typename Rep, typename Period, typename F>
+    TimerId schedule_after(const chrono::duration<Rep, Period>& delay, F&& thunk) {
+        return addTimer(chrono::duration_cast<chrono::steady_clock::duration>(delay),
+                        chrono::steady_clock::duration::zero(), Thunk(forward<F>(thunk)));
+    }
+
+  /**
+  * Schedules thunk to run every period, starting one period from now,
+  * until the timer is cancelled. Runs never overlap: if one is still
+  * going when the next is due, that one is skipped. Throws
+  * invalid_argument if period is not positive.
   */
-    void schedule(const function<void(void)>& thunk);
+    template <typename Rep, typename Period, typename F>
+    TimerId schedule_every(const chrono::duration<Rep, Period>& period, F&& thunk) {
+        chrono::steady_clock::duration every =
+            chrono::duration_cast<chrono::steady_clock::duration>(period);
+        if (every <= chrono::steady_clock::duration::zero()) {
+            throw invalid_argument("El período debe ser positivo.");
+        }
+        return addTimer(every, every, Thunk(forward<F>(thunk)));
+    }
+
+  /**
+  * Cancels a timer before it fires (or, if periodic, before it fires
+  * again).
+  *
+  * @return false if it already fired or was cancelled.
+  */
+    bool cancel_timer(TimerId timer);
+
+  /**
+  * @return How many timers are waiting to fire.
+  */
+    size_t pending_timers() const;
 
   /**
   * Blocks and waits until all previously scheduled thunks
@@ -62,35 +471,187 @@ class ThreadPool {
   */
     void wait();
 
+  /**
+  * Runs one queued thunk on the calling thread, if it finds one. Meant
+  * for code that waits for other thunks from inside a thunk (see
+  * parallel.h), so the worker it occupies keeps doing useful work.
+  *
+  * @return true if a thunk was run.
+  */
+    bool run_pending_task();
+
+  /**
+  * @return true if the caller is one of this pool's threads.
+  */
+    bool is_worker_thread() const { return currentPool == this; }
+
+  /**
+  * @return How many threads the pool is running right now.
+  */
+    size_t num_threads() const { return liveThreads; }
+
+  /**
+  * @return How many threads an elastic pool has added, and retired,
+  * since it was built (not counting the initial numThreads).
+  */
+    size_t spawned_threads() const { return spawned; }
+    size_t retired_threads() const { return retired; }
+
+  /**
+  * @return How many thunks wait in the given lane, and how many were
+  * dropped from it for missing their deadline.
+  */
+    LaneStats lane_stats(TaskPriority priority) const;
+
+  /**
+  * @return How many thunks wait to be started, the most that ever
+  * did, and what the queue's capacity made schedulers do. An unbounded
+  * pool does not tell waiting thunks from running ones, and counts
+  * both.
+  */
+    QueueStats queue_stats() const;
+
+  /**
+  * @return The histograms and busy/idle times recorded since the pool
+  * was built, added up over all threads. Empty (with enabled false)
+  * unless the pool was built with THREADPOOL_STATS defined.
+  *
+  * A thunk is recorded after it returns, so one that a TaskGroup::wait
+  * or Future::get has already seen finish may not be counted yet; after
+  * wait() every thunk is.
+  */
+    PoolStats stats() const;
+
   /**
   * Waits for all previously scheduled thunks to execute, and then
   * properly brings down the ThreadPool and any resources tapped
-  * over the course of its lifetime.
+  * over the course of its lifetime. Timers that have not fired yet are
+  * dropped.
   */
     ~ThreadPool();
-    
+
   private:
-    void worker(int id);
-    void dispatcher();
+    // How enqueueChain treats a full queue
+    enum Admission {
+        kByPolicy,     // as overflowPolicy says
+        kIfRoom,       // refuses the thunks (try_schedule)
+        kAlways        // lets them in anyway (due timers, co_await schedule())
+    };
+
+    static ThreadPoolOptions withThreads(size_t numThreads);
+    static ThunkNode *acquireNodes(size_t count);
+    static void releaseNodes(ThunkNode *head);
+    bool enqueue(Thunk&& thunk, TaskPriority priority = kNormalPriority,
+                 Deadline deadline = Deadline::max(), Admission admission = kByPolicy);
+    bool enqueueChain(ThunkNode *head, ThunkNode *tail, size_t count,
+                      TaskPriority priority = kNormalPriority, Admission admission = kByPolicy);
+    bool admit(size_t count, Admission admission);
+    bool tryAdmit(size_t count);
+    void notePeak(size_t depth);
+    void leaveQueue();
+    void runInCaller(ThunkNode *head, TaskPriority priority);
+    TimerId addTimer(chrono::steady_clock::duration delay, chrono::steady_clock::duration period,
+                     Thunk&& thunk);
+    void worker(size_t id);
+    ThunkNode *findThunk(size_t id);
+    ThunkNode *popLane(size_t lane, size_t node);
+    ThunkNode *popLanes(size_t node);
+    size_t laneDepth(size_t lane) const;
+    size_t callerNode() const;
+    static size_t numLaneNodes(const ThreadPoolOptions& options);
+    ThunkNode *stealThunk(size_t id);
+    void wake(size_t count);
+    void startWorker(size_t slot);
+    void noteBacklog();
+    bool sleep(size_t id);
+    ThunkNode *spinForThunk(size_t id);
+    void adaptSpin(size_t id, chrono::steady_clock::duration idleFor);
+    void runThunk(ThunkNode *thunk);
+#ifdef THREADPOOL_STATS
+    void recordRun(const ThunkNode *thunk, uint64_t depth, uint64_t startedAt, uint64_t endedAt);
+    void beginIdle(size_t id);
+    void endIdle(size_t id);
+#endif
+    void finishThunk();
 
-    // Threads
-    thread dt;
+    // Threads; wts has a slot for each thread the pool may run, the
+    // first highWater of which have been used
     vector<worker_t> wts;
     atomic<bool> done;
+    atomic<size_t> liveThreads;
+    atomic<size_t> highWater;
 
-    // Task queue management
-    queue<function<void(void)>> taskQueue;
-    mutex queueLock;
-    Semaphore tasksInQueue;
+    // Elastic growth: backlogSince is when thunks started waiting with no
+    // idle worker (steady_clock ticks), or 0 while there is none
+    size_t minThreads;
+    bool elastic;
+    chrono::steady_clock::duration spawnAfter;
+    chrono::steady_clock::duration idleTimeout;
+    atomic<chrono::steady_clock::rep> backlogSince;
+    atomic<size_t> spawned;
+    atomic<size_t> retired;
+    mutex growLock;
 
-    // Worker coordination
-    Semaphore availableWorkers;
+    // Priority lanes, one set per NUMA node. The normal one is the
+    // injection queue for thunks scheduled from outside the pool; with
+    // kLockFreeRing, its linked queues only hold what did not fit in ring
+    unique_ptr<BoundedMPMCQueue<ThunkNode *>> ring;
+    vector<NodeLanes> nodeLanes;
+    const CpuTopology& topology;
+    atomic<size_t> expired[kNumPriorities];
+    unsigned laneWeights[kNumPriorities];
+    unsigned totalWeight;
+    atomic<size_t> laneTicket;     // picks made by weighted round robin
+
+    // Idle workers sleep on wakeups; idleWorkers counts the ones
+    // nobody has posted a wakeup for yet. spinningWorkers counts the
+    // ones still looking for work before sleeping that no scheduler has
+    // counted on to take its thunk yet
+    Semaphore wakeups;
+    atomic<int> idleWorkers;
+    atomic<int> spinningWorkers;
+    ThreadPoolOptions::IdlePolicy idlePolicy;
+    chrono::steady_clock::duration idleSpin;
+    unsigned idleYields;
+
+    // Delayed and periodic thunks; the wheel is created with the first
+    // timer, and closed by the destructor
+    unique_ptr<TimerWheel> timers;
+    bool timersClosed;
+    mutable mutex timersLock;
+    chrono::microseconds timerTick;
+
+    // Backpressure: on bounded pools queued counts the thunks scheduled
+    // and not started; unbounded ones skip it, taking queuePeak from
+    // pending_tasks instead. Schedulers waiting for room
+    // sleep on roomCond; waitingProducers tells the workers taking
+    // thunks whether anyone has to be notified
+    size_t queueCapacity;
+    ThreadPoolOptions::OverflowPolicy overflowPolicy;
+    atomic<size_t> queued;
+    atomic<size_t> queuePeak;
+    atomic<int> waitingProducers;
+    atomic<size_t> blockedCount;
+    atomic<size_t> rejectedCount;
+    atomic<size_t> callerRunCount;
+    mutex roomLock;
+    condition_variable roomCond;
 
     // Wait/completion management
-    size_t pending_tasks;
+    atomic<size_t> pending_tasks;
     mutex wait_mutex;
     condition_variable wait_cond;
-  
+
+#ifdef THREADPOOL_STATS
+    // What threads outside the pool record, when they help run thunks
+    WorkerStats outsideStats;
+    mutable mutex outsideStatsLock;
+#endif
+
+    // The pool and worker index of the calling thread, if it is a worker
+    static thread_local ThreadPool *currentPool;
+    static thread_local size_t currentWorker;
+
     /* ThreadPools are the type of thing that shouldn't be cloneable, since it's
     * not clear what it means to clone a ThreadPool (should copies of all outstanding
     * functions to be executed be copied?).
@@ -0,0 +1,141 @@
+/**
+ * File: thunk.h
+ * -------------
+ * Defines Thunk, the move-only callable the ThreadPool stores scheduled
+ * work in. Unlike function<void(void)> it is never copied, and callables
+ * of up to kInlineSize bytes (which covers lambdas capturing a handful of
+ * values or references) are stored inside the Thunk itself instead of on
+ * the heap.
+ */
+
+#ifndef _thunk_
+#define _thunk_
+
+#include <cstddef>      // for size_t, max_align_t
+#include <new>          // for placement new
+#include <type_traits>  // for decay, enable_if, is_same, integral_constant
+#include <utility>      // for move, forward
+
+using namespace std;
+
+class Thunk {
+  public:
+    static const size_t kInlineSize = 48;
+
+  /**
+  * Constructs an empty Thunk, which must not be invoked.
+  */
+    Thunk() noexcept : ops_(nullptr) {}
+
+  /**
+  * Wraps any callable taking no arguments, moving it in when given an
+  * rvalue. Only callables too big (or unsafe to move) for the inline
+  * buffer are allocated on the heap.
+  */
+    template <typename F,
+              typename = typename enable_if<!is_same<typename decay<F>::type, Thunk>::value>::type>
+    Thunk(F&& fn) {
+        typedef typename decay<F>::type Fn;
+        store<Fn>(forward<F>(fn), integral_constant<bool, fitsInline<Fn>()>());
+    }
+
+    Thunk(Thunk&& other) noexcept : ops_(other.ops_) {
+        if (ops_ != nullptr) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    Thunk& operator=(Thunk&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if (ops_ != nullptr) {
+                ops_->move(storage_, other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~Thunk() { reset(); }
+
+  /**
+  * Invokes the wrapped callable.
+  */
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+  /**
+  * Destroys the wrapped callable (and whatever it captured), leaving
+  * the Thunk empty.
+  */
+    void reset() noexcept {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+  private:
+    struct Ops {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src);    // move-constructs dst from src, destroying src
+        void (*destroy)(void *storage);
+    };
+
+    template <typename Fn>
+    static constexpr bool fitsInline() {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(max_align_t) &&
+               is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn, typename F>
+    void store(F&& fn, true_type /* inline */) {
+        new (storage_) Fn(forward<F>(fn));
+        ops_ = &InlineOps<Fn>::ops;
+    }
+
+    template <typename Fn, typename F>
+    void store(F&& fn, false_type /* on the heap */) {
+        *reinterpret_cast<Fn **>(storage_) = new Fn(forward<F>(fn));
+        ops_ = &HeapOps<Fn>::ops;
+    }
+
+    template <typename Fn>
+    struct InlineOps {
+        static void invoke(void *s) { (*static_cast<Fn *>(s))(); }
+        static void move(void *d, void *s) {
+            new (d) Fn(std::move(*static_cast<Fn *>(s)));
+            static_cast<Fn *>(s)->~Fn();
+        }
+        static void destroy(void *s) { static_cast<Fn *>(s)->~Fn(); }
+        static const Ops ops;
+    };
+
+    template <typename Fn>
+    struct HeapOps {
+        static Fn *&ptr(void *s) { return *static_cast<Fn **>(s); }
+        static void invoke(void *s) { (*ptr(s))(); }
+        static void move(void *d, void *s) { ptr(d) = ptr(s); }
+        static void destroy(void *s) { delete ptr(s); }
+        static const Ops ops;
+    };
+
+    alignas(max_align_t) unsigned char storage_[kInlineSize];
+    const Ops *ops_;
+
+    Thunk(const Thunk& original) = delete;
+    Thunk& operator=(const Thunk& rhs) = delete;
+};
+
+template <typename Fn>
+const Thunk::Ops Thunk::InlineOps<Fn>::ops = {&InlineOps<Fn>::invoke, &InlineOps<Fn>::move,
+                                              &InlineOps<Fn>::destroy};
+
+template <typename Fn>
+const Thunk::Ops Thunk::HeapOps<Fn>::ops = {&HeapOps<Fn>::invoke, &HeapOps<Fn>::move,
+                                            &HeapOps<Fn>::destroy};
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * File: timer-wheel.cc
+ * --------------------
+ * Presents the implementation of the TimerWheel class.
+ */
+
+#include "timer-wheel.h"
+#include <algorithm>
+
+using namespace std;
+
+static const uint64_t kNever = UINT64_MAX;
+
+const int TimerWheel::kSlotBits;
+const uint32_t TimerWheel::kSlots;
+const int TimerWheel::kLevels;
+const uint32_t TimerWheel::kNone;
+
+TimerWheel::TimerWheel(Duration tick, function<void(Thunk&&)> dispatch)
+    : tick(tick > Duration::zero() ? tick : Duration(1)),
+      start(chrono::steady_clock::now()),
+      dispatch(move(dispatch)),
+      freeList(kNone),
+      now(0),
+      wakeTick(0),
+      pending(0),
+      stopping(false)
+{
+    fill(heads, heads + kLevels * kSlots, kNone);
+    ticker = thread([this] { run(); });
+}
+
+TimerWheel::~TimerWheel() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    ticker.join();
+}
+
+uint64_t TimerWheel::clockTick() const {
+    return (chrono::steady_clock::now() - start) / tick;
+}
+
+size_t TimerWheel::size() const {
+    lock_guard<mutex> guard(lock);
+    return pending;
+}
+
+uint32_t TimerWheel::allocate() {
+    if (freeList == kNone) {
+        timers.push_back(Timer());
+        return timers.size() - 1;
+    }
+    uint32_t index = freeList;
+    freeList = timers[index].next;
+    return index;
+}
+
+/**
+ * @brief Returns a timer's entry to the free list. Its thunks go to
+ * garbage, to be destroyed once the lock is released (they may hold
+ * anything).
+ */
+void TimerWheel::release(uint32_t index, vector<Thunk>& garbage) {
+    Timer& timer = timers[index];
+    if (timer.thunk) garbage.push_back(move(timer.thunk));
+    timer.periodic.reset();
+    if (++timer.generation == 0) timer.generation = 1;    // keep ids nonzero
+    timer.next = freeList;
+    freeList = index;
+}
+
+/**
+ * @brief Links a timer into the slot covering its expiry: in level 0 if
+ * that is less than 256 ticks away, in level 1 if less than 256^2, and
+ * so on. Timers further away than the wheel spans wait in the last slot
+ * it reaches and are placed again when it cascades.
+ */
+void TimerWheel::insert(uint32_t index) {
+    Timer& timer = timers[index];
+    uint64_t at = max(timer.expiry, now);
+    const uint64_t span = uint64_t(1) << (kSlotBits * kLevels);
+    if (at - now >= span) at = now + span - 1;
+    int level = 0;
+    while (at - now >= uint64_t(1) << (kSlotBits * (level + 1))) level++;
+
+    uint32_t slot = level * kSlots + ((at >> (kSlotBits * level)) & (kSlots - 1));
+    timer.slot = slot;
+    timer.prev = kNone;
+    timer.next = heads[slot];
+    if (timer.next != kNone) timers[timer.next].prev = index;
+    heads[slot] = index;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    Timer& timer = timers[index];
+    if (timer.prev != kNone) {
+        timers[timer.prev].next = timer.next;
+    } else {
+        heads[timer.slot] = timer.next;
+    }
+    if (timer.next != kNone) timers[timer.next].prev = timer.prev;
+    timer.slot = kNone;
+}
+
+TimerId TimerWheel::add(Duration delay, Duration period, Thunk&& thunk) {
+    lock_guard<mutex> guard(lock);
+    // an idle wheel's thread sleeps without moving now, so catch up here
+    // (the slots are empty) rather than have it step through every tick
+    // missed, lock held, before the new timer comes due
+    if (pending == 0) now = max(now, clockTick());
+    uint32_t index = allocate();
+    Timer& timer = timers[index];
+    if (period > Duration::zero()) {
+        timer.periodic = make_shared<Periodic>(move(thunk));
+        timer.period = max<uint64_t>(1, (period + tick - Duration(1)) / tick);
+    } else {
+        timer.thunk = move(thunk);
+        timer.period = 0;
+    }
+    // due at the first tick boundary at or after the delay, and never at
+    // a tick already processed
+    Duration due = chrono::steady_clock::now() - start + max(delay, Duration::zero());
+    timer.expiry = max<uint64_t>((due + tick - Duration(1)) / tick, now + 1);
+    insert(index);
+    pending++;
+
+    if (wakeTick != 0 && timer.expiry < wakeTick) wakeup.notify_one();
+    return (uint64_t)timer.generation << 32 | index;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    vector<Thunk> garbage;    // destroyed after the lock is released
+    lock_guard<mutex> guard(lock);
+    uint32_t index = (uint32_t)id;
+    if (index >= timers.size()) return false;
+    Timer& timer = timers[index];
+    if (timer.generation != id >> 32 || timer.slot == kNone) return false;
+    unlink(index);
+    if (timer.periodic) timer.periodic->cancelled = true;
+    release(index, garbage);
+    pending--;
+    return true;
+}
+
+/**
+ * @brief Fires a due timer: a one-off one is released and its thunk
+ * handed out, a periodic one is handed out (unless its last firing is
+ * still running) and placed again one period later, skipping periods it
+ * is already late for.
+ */
+void TimerWheel::fire(uint32_t index, vector<Thunk>& due) {
+    Timer& timer = timers[index];
+    if (!timer.periodic) {
+        due.push_back(move(timer.thunk));
+        release(index, due);
+        pending--;
+        return;
+    }
+    shared_ptr<Periodic> periodic = timer.periodic;
+    if (!periodic->running.exchange(true)) {
+        due.push_back(Thunk([periodic] {
+            if (!periodic->cancelled) periodic->fn();
+            periodic->running = false;
+        }));
+    }
+    while (timer.expiry <= now) timer.expiry += timer.period;
+    insert(index);
+}
+
+/**
+ * @brief Processes one more tick: when level 0 comes round, cascades
+ * the slots of the levels above that come round too (top-down, so
+ * timers can fall through several levels), then fires level 0's slot.
+ */
+void TimerWheel::advance(vector<Thunk>& due) {
+    now++;
+    if ((now & (kSlots - 1)) == 0) {
+        int top = 1;
+        while (top < kLevels - 1 && ((now >> (kSlotBits * top)) & (kSlots - 1)) == 0) top++;
+        for (int level = top; level >= 1; level--) {
+            uint32_t slot = level * kSlots + ((now >> (kSlotBits * level)) & (kSlots - 1));
+            uint32_t index = heads[slot];
+            heads[slot] = kNone;
+            while (index != kNone) {
+                uint32_t next = timers[index].next;
+                insert(index);
+                index = next;
+            }
+        }
+    }
+
+    uint32_t slot = now & (kSlots - 1);
+    uint32_t index = heads[slot];
+    heads[slot] = kNone;
+    while (index != kNone) {
+        uint32_t next = timers[index].next;
+        timers[index].slot = kNone;
+        if (timers[index].expiry > now) {
+            insert(index);    // parked here while beyond the wheel's span
+        } else {
+            fire(index, due);
+        }
+        index = next;
+    }
+}
+
+/**
+ * @brief The tick the thread has to wake up at: the next one with
+ * timers in level 0, or the next cascade if there is none before it.
+ */
+uint64_t TimerWheel::nextEventTick() const {
+    if (pending == 0) return kNever;
+    uint64_t cascade = (now | (kSlots - 1)) + 1;
+    for (uint64_t t = now + 1; t < cascade; t++) {
+        if (heads[t & (kSlots - 1)] != kNone) return t;
+    }
+    return cascade;
+}
+
+void TimerWheel::run() {
+    unique_lock<mutex> guard(lock);
+    vector<Thunk> due;
+    while (!stopping) {
+        uint64_t target = clockTick();
+        // with nothing pending there is nothing to step through
+        if (pending == 0) now = max(now, target);
+        while (now < target) advance(due);
+        if (!due.empty()) {
+            guard.unlock();
+            for (Thunk& thunk : due) {
+                if (thunk) dispatch(move(thunk));
+            }
+            due.clear();
+            guard.lock();
+            continue;
+        }
+
+        wakeTick = nextEventTick();
+        if (wakeTick == kNever) {
+            wakeup.wait(guard);
+        } else {
+            wakeup.wait_until(guard, start + tick * wakeTick);
+        }
+        wakeTick = 0;
+    }
+}
@@ -0,0 +1,131 @@
+/**
+ * File: timer-wheel.h
+ * -------------------
+ * Defines TimerWheel, which holds thunks until a delay has passed and
+ * then hands them to a dispatch function (ThreadPool's, which queues
+ * them for its workers), so nothing occupies a worker while it waits.
+ *
+ * Time is cut into ticks, and timers live in a hierarchical timing
+ * wheel: four levels of 256 slots, where a slot of level 0 holds the
+ * timers due in one tick and a slot of level k the ones due in a span
+ * of 256^k ticks. Adding or cancelling a timer links or unlinks it from
+ * one slot, O(1) however many timers are pending; every 256 ticks the
+ * next slot of the level above is cascaded, its timers spread over the
+ * level below. One thread advances the wheel, sleeping until the next
+ * tick with timers due (or the next cascade).
+ */
+
+#ifndef _timer_wheel_
+#define _timer_wheel_
+
+#include <atomic>              // for atomic
+#include <chrono>              // for steady_clock
+#include <condition_variable>  // for condition_variable
+#include <cstddef>             // for size_t
+#include <cstdint>             // for uint32_t, uint64_t
+#include <functional>          // for function
+#include <memory>              // for shared_ptr
+#include <mutex>               // for mutex
+#include <thread>              // for thread
+#include <vector>              // for vector
+#include "thunk.h"             // for Thunk
+
+using namespace std;
+
+/**
+ * @brief Identifies a timer, to cancel it. 0 is never a timer's id.
+ */
+typedef uint64_t TimerId;
+
+class TimerWheel {
+  public:
+    typedef chrono::steady_clock::duration Duration;
+
+  /**
+  * Constructs an empty wheel advancing every tick, and starts its
+  * thread. Due thunks are passed to dispatch from that thread.
+  */
+    TimerWheel(Duration tick, function<void(Thunk&&)> dispatch);
+
+  /**
+  * Adds a timer that dispatches thunk once delay has passed (rounded up
+  * to a tick) or, if period is positive, every period after that. A
+  * periodic thunk is dispatched at most once at a time: a firing while
+  * the last one has not finished running is skipped.
+  */
+    TimerId add(Duration delay, Duration period, Thunk&& thunk);
+
+  /**
+  * Cancels a pending timer; a periodic one is not dispatched again, and
+  * a firing of it already dispatched but not started does not run.
+  *
+  * @return false if the timer already fired (if not periodic) or was
+  * cancelled.
+  */
+    bool cancel(TimerId id);
+
+  /**
+  * @return How many timers are pending.
+  */
+    size_t size() const;
+
+  /**
+  * Stops the thread; pending timers are dropped without running.
+  */
+    ~TimerWheel();
+
+  private:
+    static const int kSlotBits = 8;
+    static const uint32_t kSlots = 1 << kSlotBits;
+    static const int kLevels = 4;
+    static const uint32_t kNone = UINT32_MAX;   // no timer (ends a list) / no slot
+
+    // What the firings of a periodic timer share
+    struct Periodic {
+        explicit Periodic(Thunk&& fn) : fn(move(fn)) {}
+        Thunk fn;
+        atomic<bool> running{false};     // a firing is dispatched and not finished
+        atomic<bool> cancelled{false};
+    };
+
+    struct Timer {
+        Thunk thunk;                     // if not periodic
+        shared_ptr<Periodic> periodic;   // if periodic
+        uint64_t expiry = 0;             // tick it is due at
+        uint64_t period = 0;             // in ticks, 0 if not periodic
+        uint32_t prev = kNone;           // in its slot's list
+        uint32_t next = kNone;           // in its slot's list, or in the free list
+        uint32_t slot = kNone;           // kNone if not pending
+        uint32_t generation = 1;         // bumped on reuse, so stale ids miss
+    };
+
+    uint64_t clockTick() const;
+    uint32_t allocate();
+    void release(uint32_t index, vector<Thunk>& garbage);
+    void insert(uint32_t index);
+    void unlink(uint32_t index);
+    void advance(vector<Thunk>& due);
+    void fire(uint32_t index, vector<Thunk>& due);
+    uint64_t nextEventTick() const;
+    void run();
+
+    const Duration tick;
+    const chrono::steady_clock::time_point start;
+    function<void(Thunk&&)> dispatch;
+
+    mutable mutex lock;
+    condition_variable wakeup;
+    vector<Timer> timers;                 // indexed by the low half of a TimerId
+    uint32_t freeList;                    // unused entries of timers
+    uint32_t heads[kLevels * kSlots];     // first timer in each slot
+    uint64_t now;                         // last tick processed
+    uint64_t wakeTick;                    // tick the thread sleeps until, 0 if awake
+    size_t pending;
+    bool stopping;
+    thread ticker;
+
+    TimerWheel(const TimerWheel& original) = delete;
+    TimerWheel& operator=(const TimerWheel& rhs) = delete;
+};
+
+#endif
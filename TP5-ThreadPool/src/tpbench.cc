@@ -0,0 +1,407 @@
+/**
+ * File: tpbench.cc
+ * ----------------
+ * Benchmarks the ThreadPool across pool configurations:
+ *
+ *   - throughput: empty thunks per second, scheduled one by one or as a
+ *     schedule_n batch, for each injection queue and pool size.
+ *   - latency: percentiles of the time from scheduling a thunk onto an
+ *     idle pool to a worker starting it, for each idle policy.
+ *   - fork-join: the cost of a TaskGroup forking that many empty thunks
+ *     and joining them.
+ *   - parallel-for: how a compute-bound parallel_for scales with the
+ *     number of threads, for each partitioning.
+ *   - producers: throughput when many threads schedule at once, for each
+ *     injection queue.
+ *
+ *     ./tpbench [--json] [--tasks N] [--threads n,n,...] [benchmark ...]
+ *
+ * With no benchmarks named it runs them all; with no thread counts it
+ * uses 1, 2, 4, ... up to the number of CPUs. --json prints one JSON
+ * object per line (first one describing the build) instead of tables,
+ * for comparing builds with a script.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdlib>
+#include "thread-pool.h"
+#include "task-group.h"
+#include "parallel.h"
+
+using namespace std;
+
+static const size_t kDefaultTasks = 200000;
+static const size_t kRepeats = 3;
+static const size_t kLatencySamples = 20000;
+static const size_t kForkWidths[] = {1, 16, 256};
+static const size_t kForkJoinThunks = 200000;   // thunks per fork-join measurement
+static const size_t kLoopLength = 1 << 22;
+static const size_t kProducerCounts[] = {1, 2, 4, 8, 16};
+
+struct queueConfig {
+    const char *name;
+    ThreadPoolOptions::QueueKind kind;
+};
+
+static const queueConfig kQueues[] = {
+    {"locked", ThreadPoolOptions::kLockedQueue},
+    {"ring", ThreadPoolOptions::kLockFreeRing},
+};
+
+struct idleConfig {
+    const char *name;
+    ThreadPoolOptions::IdlePolicy policy;
+};
+
+static const idleConfig kIdlePolicies[] = {
+    {"park", ThreadPoolOptions::kParkImmediately},
+    {"spin", ThreadPoolOptions::kSpinThenPark},
+    {"adaptive", ThreadPoolOptions::kAdaptiveSpin},
+};
+
+struct partitionConfig {
+    const char *name;
+    PartitionKind kind;
+};
+
+static const partitionConfig kPartitions[] = {
+    {"static", kStaticPartition},
+    {"guided", kGuidedPartition},
+    {"adaptive", kAdaptivePartition},
+};
+
+/**
+ * @brief Prints the results of a benchmark, either as a table (one
+ * column per field) or as one JSON object per row.
+ */
+class Reporter {
+  public:
+    explicit Reporter(bool json) : json(json) {}
+
+  /**
+  * Starts a benchmark whose rows have the given fields.
+  */
+    void begin(const string& benchmark, const vector<string>& fields) {
+        name = benchmark;
+        columns = fields;
+        if (json) return;
+        cout << endl << benchmark << endl;
+        for (const string& column : columns) cout << setw(width(column)) << column;
+        cout << endl;
+    }
+
+    Reporter& text(const string& value) {
+        values.push_back(make_pair(value, false));
+        return *this;
+    }
+
+    Reporter& number(double value, int precision = 0) {
+        ostringstream formatted;
+        formatted << fixed << setprecision(precision) << value;
+        values.push_back(make_pair(formatted.str(), true));
+        return *this;
+    }
+
+  /**
+  * Prints the values given since the last row, one per field.
+  */
+    void row() {
+        if (json) {
+            cout << "{\"benchmark\": \"" << name << "\"";
+            for (size_t i = 0; i < values.size(); i++) {
+                const string& value = values[i].first;
+                cout << ", \"" << columns[i] << "\": "
+                     << (values[i].second ? value : "\"" + value + "\"");
+            }
+            cout << "}" << endl;
+        } else {
+            for (size_t i = 0; i < values.size(); i++) {
+                cout << setw(width(columns[i])) << values[i].first;
+            }
+            cout << endl;
+        }
+        values.clear();
+    }
+
+  /**
+  * In JSON mode, prints a first line describing the build, so results of
+  * different builds can be told apart.
+  */
+    void build() {
+        if (!json) return;
+        cout << "{\"benchmark\": \"build\", \"compiler\": \"" << __VERSION__ << "\", \"optimized\": "
+#ifdef __OPTIMIZE__
+             << "true"
+#else
+             << "false"
+#endif
+             << ", \"stats\": " << (ThreadPool(1).stats().enabled ? "true" : "false")
+             << ", \"cpus\": " << thread::hardware_concurrency() << "}" << endl;
+    }
+
+  private:
+    static int width(const string& column) { return max<int>(10, column.size() + 2); }
+
+    bool json;
+    string name;
+    vector<string> columns;
+    vector<pair<string, bool>> values;   // each with whether it is a number
+};
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Schedules numTasks empty thunks, split among numProducers
+ * threads (each scheduling its share one by one, or with one schedule_n
+ * call if bulk is set), on a fresh pool and waits for them.
+ *
+ * @return The best tasks/second over kRepeats runs.
+ */
+static double emptyTaskThroughput(ThreadPoolOptions options, size_t numProducers, size_t numTasks,
+                                  bool bulk) {
+    double best = 0;
+    for (size_t r = 0; r < kRepeats; r++) {
+        ThreadPool pool(options);
+        auto start = chrono::steady_clock::now();
+        vector<thread> producers;
+        for (size_t p = 0; p < numProducers; p++) {
+            size_t count = numTasks / numProducers + (p < numTasks % numProducers);
+            producers.push_back(thread([&pool, count, bulk] {
+                if (bulk) {
+                    pool.schedule_n(count, [](size_t) {});
+                    return;
+                }
+                for (size_t i = 0; i < count; i++) {
+                    pool.schedule([] {});
+                }
+            }));
+        }
+        for (thread& producer : producers) producer.join();
+        pool.wait();
+        double rate = numTasks / secondsSince(start);
+        if (rate > best) best = rate;
+    }
+    return best;
+}
+
+static void throughputBenchmark(Reporter& report, const vector<size_t>& threadCounts,
+                                size_t numTasks) {
+    report.begin("throughput", {"queue", "mode", "threads", "tasks", "tasks_per_s"});
+    for (const queueConfig& queue : kQueues) {
+        for (int bulk = 0; bulk <= 1; bulk++) {
+            for (size_t n : threadCounts) {
+                ThreadPoolOptions options;
+                options.numThreads = n;
+                options.injectionQueue = queue.kind;
+                report.text(queue.name).text(bulk ? "bulk" : "single").number(n).number(numTasks)
+                      .number(emptyTaskThroughput(options, 1, numTasks, bulk));
+                report.row();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Schedules kLatencySamples thunks one at a time, each noting when
+ * it started and then signalling a semaphore the scheduling thread waits
+ * on before sending the next, so every thunk lands on a pool whose
+ * workers just ran out of work. The timestamp is taken in the thunk, so
+ * the scheduling thread's own wakeup is not measured.
+ *
+ * @return The nanoseconds from each schedule() to its thunk starting.
+ */
+static Histogram scheduleToStartLatency(ThreadPoolOptions options) {
+    ThreadPool pool(options);
+    Semaphore done;
+    Histogram latencies;
+    for (size_t i = 0; i < kLatencySamples; i++) {
+        chrono::steady_clock::time_point started;
+        auto start = chrono::steady_clock::now();
+        pool.schedule([&done, &started] {
+            started = chrono::steady_clock::now();
+            done.signal();
+        });
+        done.wait();
+        latencies.record(chrono::duration_cast<chrono::nanoseconds>(started - start).count());
+    }
+    return latencies;
+}
+
+static void latencyBenchmark(Reporter& report, const vector<size_t>& threadCounts) {
+    report.begin("latency", {"idle", "threads", "start_mean_us", "start_p50_us", "start_p90_us",
+                             "start_p99_us", "start_max_us"});
+    for (const idleConfig& idle : kIdlePolicies) {
+        for (size_t n : threadCounts) {
+            ThreadPoolOptions options;
+            options.numThreads = n;
+            options.idlePolicy = idle.policy;
+            Histogram latencies = scheduleToStartLatency(options);
+            report.text(idle.name).number(n).number(latencies.mean() / 1000, 2)
+                  .number(latencies.percentile(50) / 1000.0, 2)
+                  .number(latencies.percentile(90) / 1000.0, 2)
+                  .number(latencies.percentile(99) / 1000.0, 2)
+                  .number(latencies.max() / 1000.0, 2);
+            report.row();
+        }
+    }
+}
+
+/**
+ * @brief Forks width empty thunks on a TaskGroup and joins them, over
+ * and over, from outside the pool.
+ *
+ * @return The best microseconds per fork-join over kRepeats runs.
+ */
+static double forkJoinCost(size_t numThreads, size_t width) {
+    ThreadPool pool(numThreads);
+    size_t joins = max<size_t>(1, kForkJoinThunks / width);
+    double best = 0;
+    for (size_t r = 0; r < kRepeats; r++) {
+        auto start = chrono::steady_clock::now();
+        for (size_t j = 0; j < joins; j++) {
+            TaskGroup group(pool);
+            group.run_n(width, [](size_t) {});
+            group.wait();
+        }
+        double cost = secondsSince(start) * 1e6 / joins;
+        if (r == 0 || cost < best) best = cost;
+    }
+    return best;
+}
+
+static void forkJoinBenchmark(Reporter& report, const vector<size_t>& threadCounts) {
+    report.begin("fork-join", {"threads", "width", "us_per_join", "ns_per_task"});
+    for (size_t n : threadCounts) {
+        for (size_t width : kForkWidths) {
+            double cost = forkJoinCost(n, width);
+            report.number(n).number(width).number(cost, 2).number(cost * 1000 / width, 1);
+            report.row();
+        }
+    }
+}
+
+/**
+ * @brief Times a parallel_for over kLoopLength indices doing a little
+ * floating point work each.
+ *
+ * @return The best seconds over kRepeats runs.
+ */
+static double parallelForTime(size_t numThreads, PartitionKind kind) {
+    ThreadPool pool(numThreads);
+    vector<double> out(kLoopLength);
+    double best = 0;
+    for (size_t r = 0; r < kRepeats; r++) {
+        auto start = chrono::steady_clock::now();
+        parallel_for(pool, IndexRange{0, kLoopLength}, 0, [&out](size_t i) {
+            double x = (double)i;
+            out[i] = sqrt(x) * sin(x) + cos(x);
+        }, kind);
+        double elapsed = secondsSince(start);
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static void parallelForBenchmark(Reporter& report, const vector<size_t>& threadCounts) {
+    report.begin("parallel-for", {"partition", "threads", "ms", "speedup", "efficiency"});
+    for (const partitionConfig& partition : kPartitions) {
+        double base = 0;
+        for (size_t n : threadCounts) {
+            double elapsed = parallelForTime(n, partition.kind);
+            // speedups are relative to the first thread count, taken as linear
+            if (base == 0) base = elapsed * threadCounts[0];
+            double speedup = base / elapsed;
+            report.text(partition.name).number(n).number(elapsed * 1000, 2).number(speedup, 2)
+                  .number(speedup / n, 2);
+            report.row();
+        }
+    }
+}
+
+static void producersBenchmark(Reporter& report, const vector<size_t>& threadCounts,
+                               size_t numTasks) {
+    report.begin("producers", {"queue", "threads", "producers", "tasks", "tasks_per_s"});
+    size_t n = threadCounts.back();
+    for (const queueConfig& queue : kQueues) {
+        for (size_t producers : kProducerCounts) {
+            ThreadPoolOptions options;
+            options.numThreads = n;
+            options.injectionQueue = queue.kind;
+            report.text(queue.name).number(n).number(producers).number(numTasks)
+                  .number(emptyTaskThroughput(options, producers, numTasks, false));
+            report.row();
+        }
+    }
+}
+
+static vector<size_t> parseThreadCounts(const char *list) {
+    vector<size_t> counts;
+    stringstream items(list);
+    string item;
+    while (getline(items, item, ',')) {
+        size_t count = strtoul(item.c_str(), NULL, 0);
+        if (count > 0) counts.push_back(count);
+    }
+    return counts;
+}
+
+int main(int argc, char *argv[]) {
+    bool json = false;
+    size_t numTasks = kDefaultTasks;
+    vector<size_t> threadCounts;
+    vector<string> selected;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--tasks") == 0 && i + 1 < argc) {
+            numTasks = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCounts = parseThreadCounts(argv[++i]);
+        } else {
+            selected.push_back(argv[i]);
+        }
+    }
+    if (threadCounts.empty()) {
+        size_t hw = thread::hardware_concurrency();
+        for (size_t n = 1; n < hw; n *= 2) threadCounts.push_back(n);
+        threadCounts.push_back(hw ? hw : 1);
+    }
+
+    Reporter report(json);
+    vector<pair<string, function<void(void)>>> benchmarks = {
+        {"throughput", [&] { throughputBenchmark(report, threadCounts, numTasks); }},
+        {"latency", [&] { latencyBenchmark(report, threadCounts); }},
+        {"fork-join", [&] { forkJoinBenchmark(report, threadCounts); }},
+        {"parallel-for", [&] { parallelForBenchmark(report, threadCounts); }},
+        {"producers", [&] { producersBenchmark(report, threadCounts, numTasks); }},
+    };
+    for (const string& name : selected) {
+        bool known = false;
+        for (const auto& entry : benchmarks) known = known || entry.first == name;
+        if (!known) {
+            cerr << "Unknown benchmark " << name << "; the benchmarks are:";
+            for (const auto& entry : benchmarks) cerr << " " << entry.first;
+            cerr << endl;
+            return 1;
+        }
+    }
+
+    report.build();
+    for (const auto& entry : benchmarks) {
+        bool run = selected.empty();
+        for (const string& name : selected) run = run || name == entry.first;
+        if (run) entry.second();
+    }
+    return 0;
+}
@@ -12,11 +12,22 @@
 #include <functional>
 #include <cstring>
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <array>
+#include <memory>
+#include <stdexcept>
 #include <sys/types.h> // used to count the number of threads
 #include <unistd.h>    // used to count the number of threads
 #include <dirent.h>    // for opendir, readdir, closedir
+#include <sched.h>     // for sched_getaffinity, sched_getcpu
+#include <sys/stat.h>  // for mkdir
 
 #include "thread-pool.h"
+#include "parallel.h"
+#include "task-group.h"
+#include "task-graph.h"
+#include "coroutine.h"
 
 
 using namespace std;
@@ -95,6 +106,818 @@ static void reuseThreadPoolTest() {
     pool.wait();
 }
 
+static void spawnTree(ThreadPool& pool, atomic<size_t>& leaves, int depth) {
+    if (depth == 0) {
+        leaves++;
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        pool.schedule([&pool, &leaves, depth] { spawnTree(pool, leaves, depth - 1); });
+    }
+}
+
+static void nestedScheduleTest() {
+    ThreadPool pool(4);
+    atomic<size_t> leaves(0);
+    pool.schedule([&] { spawnTree(pool, leaves, 14); });
+    pool.wait();
+    oslock.lock();
+    cout << "Counted " << leaves << " leaves (expected " << (1 << 14) << ")." << endl;
+    oslock.unlock();
+}
+
+static void ringQueueTest() {
+    ThreadPoolOptions options;
+    options.numThreads = 4;
+    options.injectionQueue = ThreadPoolOptions::kLockFreeRing;
+    options.ringCapacity = 16;   // small enough that producers spill over
+    ThreadPool pool(options);
+    atomic<size_t> count(0);
+    vector<thread> producers;
+    for (size_t p = 0; p < 4; p++) {
+        producers.push_back(thread([&] {
+            for (size_t i = 0; i < 2500; i++) pool.schedule([&] { count++; });
+        }));
+    }
+    for (thread& producer : producers) producer.join();
+    pool.wait();
+    oslock.lock();
+    cout << "Ran " << count << " thunks (expected 10000)." << endl;
+    oslock.unlock();
+}
+
+struct moveOnlyThunk {
+    unique_ptr<int> value;
+    atomic<int> *sum;
+    void operator()() { *sum += *value; }
+};
+
+static void moveOnlyThunkTest() {
+    ThreadPool pool(4);
+    atomic<int> sum(0);
+    for (int i = 1; i <= 100; i++) {
+        pool.schedule(moveOnlyThunk{unique_ptr<int>(new int(i)), &sum});
+    }
+    // captures bigger than Thunk's inline buffer go to the heap
+    array<int, 64> big;
+    big.fill(1);
+    for (int i = 0; i < 10; i++) {
+        pool.schedule([big, &sum] { for (int v : big) sum += v; });
+    }
+    pool.wait();
+    oslock.lock();
+    cout << "Sum is " << sum << " (expected " << 5050 + 640 << ")." << endl;
+    oslock.unlock();
+}
+
+static int square(int x) { return x * x; }
+
+// a callable whose move may throw, which Thunk must not store inline
+struct ThrowingMoveSquare {
+    ThrowingMoveSquare() {}
+    ThrowingMoveSquare(const ThrowingMoveSquare&) {}
+    ThrowingMoveSquare(ThrowingMoveSquare&&) noexcept(false) {}
+    int operator()(int x) const { return x * x; }
+};
+
+static void submitFuturesTest() {
+    ThreadPool pool(4);
+    vector<Future<int>> squares;
+    for (int i = 0; i < 10; i++) {
+        squares.push_back(pool.submit(square, i));
+    }
+    Future<string> text = pool.submit([](string s, int n) { return s + to_string(n); }, string("task-"), 7);
+    Future<void> nothing = pool.submit([] { sleep_for(10); });
+    Future<int> failing = pool.submit([]() -> int { throw runtime_error("boom"); });
+    Future<int> throwingMove = pool.submit(ThrowingMoveSquare(), 12);
+    bool nothrowCall = is_nothrow_move_constructible<SubmittedCall<int, ThrowingMoveSquare, int>>::value;
+
+    int total = 0;
+    for (Future<int>& f : squares) total += f.get();
+    nothing.get();
+    string caught;
+    try {
+        failing.get();
+    } catch (const runtime_error& e) {
+        caught = e.what();
+    }
+    oslock.lock();
+    cout << "Sum of squares " << total << " (expected 285), " << text.get()
+         << ", exception \"" << caught << "\", " << throwingMove.get()
+         << " (expected 144) with a move that may throw, "
+         << (nothrowCall ? "moved as noexcept" : "not moved as noexcept") << "." << endl;
+    oslock.unlock();
+}
+
+static void bulkScheduleTest() {
+    ThreadPool pool(4);
+    atomic<size_t> indexSum(0);
+    pool.schedule_n(1000, [&](size_t i) { indexSum += i; });
+
+    atomic<int> ran(0);
+    vector<function<void(void)>> thunks(100, [&] { ran++; });
+    pool.schedule_bulk(thunks.begin(), thunks.end());
+    pool.wait();
+    oslock.lock();
+    cout << "Index sum " << indexSum << " (expected 499500), ran " << ran
+         << " bulk thunks (expected 100)." << endl;
+    oslock.unlock();
+}
+
+static void parallelLoopsTest() {
+    ThreadPool pool(4);
+    const PartitionKind kinds[] = {kStaticPartition, kGuidedPartition, kAdaptivePartition};
+    const char *names[] = {"static", "guided", "adaptive"};
+    for (size_t k = 0; k < 3; k++) {
+        vector<int> squares(1000);
+        parallel_for(pool, IndexRange{0, squares.size()}, 0,
+                     [&](size_t i) { squares[i] = (int)(i * i); }, kinds[k]);
+        bool allSet = true;
+        for (size_t i = 0; i < squares.size(); i++) allSet = allSet && squares[i] == (int)(i * i);
+
+        // string concatenation is associative but not commutative
+        string digits = parallel_reduce(pool, IndexRange{0, 20}, string(),
+                                        [](size_t i) { return to_string(i % 10); },
+                                        [](string a, const string& b) { return a + b; }, 3, kinds[k]);
+        // bool partials must not share storage (vector<bool> would pack them)
+        bool parities = parallel_reduce(pool, IndexRange{0, squares.size()}, true,
+                                        [&](size_t i) { return squares[i] % 2 == (int)(i % 2); },
+                                        [](bool a, bool b) { return a && b; }, 1, kinds[k]);
+        oslock.lock();
+        cout << names[k] << ": squares " << (allSet ? "ok" : "WRONG") << ", digits " << digits
+             << " (expected 01234567890123456789), parities " << (parities ? "ok" : "WRONG") << "." << endl;
+        oslock.unlock();
+    }
+
+    // a loop inside a thunk helps run the pool's work instead of blocking
+    atomic<size_t> nestedSum(0);
+    parallel_for(pool, IndexRange{0, 8}, 1, [&](size_t i) {
+        nestedSum += parallel_reduce(pool, IndexRange{0, 100}, (size_t)0,
+                                     [i](size_t j) { return i * j; }, plus<size_t>(), 10);
+    });
+
+    string caught;
+    try {
+        parallel_for(pool, IndexRange{0, 100}, 1, [](size_t i) {
+            if (i == 42) throw runtime_error("bad index");
+        });
+    } catch (const runtime_error& e) {
+        caught = e.what();
+    }
+    oslock.lock();
+    cout << "Nested sum " << nestedSum << " (expected 138600), exception \"" << caught << "\"." << endl;
+    oslock.unlock();
+}
+
+static void semaphoreTest() {
+    Semaphore permits(0);
+    bool emptyTry = permits.try_wait();
+    permits.signal(3);
+    int taken = 0;
+    while (permits.try_wait()) taken++;
+    bool timedOut = !permits.wait_for(chrono::milliseconds(20));
+
+    // a timeout too long to add to the clock means no timeout at all
+    thread late([&] { sleep_for(20); permits.signal(); });
+    bool waitedLong = permits.wait_for(chrono::hours::max());
+    late.join();
+
+    // signal(n) has to wake n sleepers, not just one
+    const int kSleepers = 4;
+    atomic<int> woken(0);
+    vector<thread> sleepers;
+    for (int i = 0; i < kSleepers; i++) {
+        sleepers.push_back(thread([&] {
+            permits.wait();
+            woken++;
+        }));
+    }
+    sleep_for(20);
+    permits.signal(kSleepers);
+    for (thread& t : sleepers) t.join();
+
+    // many short handoffs between a producer and a few consumers
+    const int kPermits = 100000;
+    atomic<int> consumed(0);
+    vector<thread> consumers;
+    for (int i = 0; i < kSleepers; i++) {
+        consumers.push_back(thread([&] {
+            for (int k = 0; k < kPermits / kSleepers; k++) permits.wait();
+            consumed += kPermits / kSleepers;
+        }));
+    }
+    for (int k = 0; k < kPermits; k++) permits.signal();
+    for (thread& t : consumers) t.join();
+
+    oslock.lock();
+    cout << "try_wait on empty " << emptyTry << " (expected 0), took " << taken
+         << " of 3 permits, timed out " << timedOut << " (expected 1), endless timeout acquired " << waitedLong << " (expected 1), woke " << woken
+         << " of " << kSleepers << ", consumed " << consumed << " of " << kPermits << "." << endl;
+    oslock.unlock();
+}
+
+static size_t groupFib(ThreadPool& pool, size_t n) {
+    if (n < 2) return n;
+    size_t a = 0, b = 0;
+    TaskGroup group(pool);
+    group.run([&] { a = groupFib(pool, n - 1); });
+    b = groupFib(pool, n - 2);
+    group.wait();
+    return a + b;
+}
+
+static void taskGroupTest() {
+    ThreadPool pool(4);
+
+    // a group waits for its own thunks only
+    TaskGroup slow(pool), fast(pool);
+    atomic<bool> slowDone(false);
+    slow.run([&] { sleep_for(200); slowDone = true; });
+    atomic<int> fastRan(0);
+    fast.run_n(10, [&](size_t) { fastRan++; });
+    fast.wait();
+    bool waitedForSlow = slowDone;
+    slow.wait();
+
+    // thunks that have not started when the group is cancelled are skipped
+    ThreadPool single(1);
+    TaskGroup cancelled(single);
+    atomic<int> started(0);
+    Semaphore running(0);
+    cancelled.run([&] { started++; running.signal(); sleep_for(50); });
+    running.wait();
+    for (int i = 0; i < 10; i++) cancelled.run([&] { started++; });
+    cancelled.cancel();
+    cancelled.wait();
+
+    // nested fork-join on a small pool: waiting workers help instead of
+    // blocking, so this neither deadlocks nor needs more threads
+    ThreadPool pair(2);
+    size_t fib = 0;
+    TaskGroup outer(pair);
+    outer.run([&] { fib = groupFib(pair, 18); });
+    outer.wait();
+
+    string caught;
+    TaskGroup failing(pool);
+    failing.run([] { throw runtime_error("group boom"); });
+    try {
+        failing.wait();
+    } catch (const runtime_error& e) {
+        caught = e.what();
+    }
+    oslock.lock();
+    cout << "Fast group ran " << fastRan << " without waiting for the slow one: "
+         << (waitedForSlow ? "no" : "yes") << ", cancelled group started " << started
+         << " of 11 (expected 1), fib(18) " << fib << " (expected 2584), exception \"" << caught << "\"." << endl;
+    oslock.unlock();
+}
+
+static void taskGraphTest() {
+    ThreadPool pool(4);
+
+    // load -> {parse, index} -> merge -> {report, archive}, plus a chain
+    // of 20 tasks hanging off load
+    const size_t kStages = 6, kChain = 20;
+    vector<atomic<size_t>> stamps(kStages + kChain);
+    atomic<size_t> clock(0);
+    auto stage = [&](size_t i) { return [&, i] { stamps[i] = ++clock; }; };
+
+    TaskGraph graph;
+    TaskGraph::TaskId load = graph.add(stage(0));
+    TaskGraph::TaskId parse = graph.add(stage(1), {load});
+    TaskGraph::TaskId index = graph.add(stage(2), {load});
+    TaskGraph::TaskId merge = graph.add(stage(3), {parse, index});
+    graph.add(stage(4), {merge});
+    graph.add(stage(5), {merge});
+    TaskGraph::TaskId previous = load;
+    for (size_t i = 0; i < kChain; i++) previous = graph.add(stage(kStages + i), {previous});
+
+    const int kRuns = 100;
+    int orderedRuns = 0;
+    for (int run = 0; run < kRuns; run++) {
+        graph.run(pool);
+        bool ordered = stamps[0] < stamps[1] && stamps[0] < stamps[2] && stamps[1] < stamps[3] &&
+                       stamps[2] < stamps[3] && stamps[3] < stamps[4] && stamps[3] < stamps[5] &&
+                       stamps[0] < stamps[kStages];
+        for (size_t i = 1; i < kChain; i++) ordered = ordered && stamps[kStages + i - 1] < stamps[kStages + i];
+        orderedRuns += ordered;
+    }
+
+    // a task that throws keeps its successors from running
+    TaskGraph failing;
+    atomic<bool> afterFailure(false);
+    TaskGraph::TaskId thrower = failing.add([] { throw runtime_error("stage failed"); });
+    failing.add([&] { afterFailure = true; }, {thrower});
+    string caught;
+    try {
+        failing.run(pool);
+    } catch (const runtime_error& e) {
+        caught = e.what();
+    }
+
+    TaskGraph cyclic;
+    TaskGraph::TaskId a = cyclic.add([] {});
+    TaskGraph::TaskId b = cyclic.add([] {}, {a});
+    cyclic.add_predecessor(a, b);
+    bool cycleRejected = false;
+    try {
+        cyclic.run(pool);
+    } catch (const logic_error&) {
+        cycleRejected = true;
+    }
+
+    oslock.lock();
+    cout << orderedRuns << " of " << kRuns << " runs respected the dependencies, exception \""
+         << caught << "\", successor ran " << afterFailure << " (expected 0), cycle rejected "
+         << cycleRejected << " (expected 1)." << endl;
+    oslock.unlock();
+}
+
+static void priorityLanesTest() {
+    ThreadPool pool(1);
+    Semaphore started(0), release(0);
+    pool.schedule([&] {                         // keeps the only worker busy
+        started.signal();
+        release.wait();
+    });
+    started.wait();
+
+    const size_t kBatch = 1000;
+    mutex orderLock;
+    vector<string> order;
+    for (size_t i = 0; i < kBatch; i++) {
+        pool.schedule([&] {
+            lock_guard<mutex> lg(orderLock);
+            order.push_back("batch");
+        });
+    }
+    for (int i = 0; i < 3; i++) {
+        pool.schedule([&] {
+            lock_guard<mutex> lg(orderLock);
+            order.push_back("low");
+        }, kLowPriority);
+    }
+    atomic<bool> expiredRan(false);
+    pool.schedule([&] { expiredRan = true; }, kHighPriority,
+                  chrono::steady_clock::now() + chrono::milliseconds(1));
+    pool.schedule([&] {
+        lock_guard<mutex> lg(orderLock);
+        order.push_back("urgent");
+    }, kHighPriority);
+
+    size_t lowDepth = pool.lane_stats(kLowPriority).depth;
+    size_t highDepth = pool.lane_stats(kHighPriority).depth;
+    sleep_for(20);
+    release.signal();
+    pool.wait();
+
+    size_t urgentAt = 0, lastLowAt = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (order[i] == "urgent") urgentAt = i;
+        if (order[i] == "low") lastLowAt = i;
+    }
+    oslock.lock();
+    cout << "Urgent thunk ran " << (urgentAt < 10 ? "before" : "after") << " the batch, low thunks "
+         << (lastLowAt < kBatch ? "were not starved" : "waited for the batch") << ", depths high "
+         << highDepth << " low " << lowDepth << " (expected 2 and 3), expired "
+         << pool.lane_stats(kHighPriority).expired << " (expected 1), ran " << expiredRan
+         << " (expected 0), depth now " << pool.lane_stats(kNormalPriority).depth << "." << endl;
+    oslock.unlock();
+}
+
+static void elasticPoolTest() {
+    ThreadPoolOptions options;
+    options.numThreads = 1;
+    options.maxThreads = 4;
+    options.spawnAfter = chrono::milliseconds(2);
+    options.idleTimeout = chrono::milliseconds(50);
+    ThreadPool pool(options);
+
+    // a burst of slow thunks: the pool should grow to take them
+    atomic<size_t> peak(0);
+    for (int i = 0; i < 16; i++) {
+        pool.schedule([&] {
+            size_t now = pool.num_threads();
+            size_t seen = peak;
+            while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+            sleep_for(20);
+        });
+    }
+    pool.wait();
+    size_t spawned = pool.spawned_threads();
+
+    // then, at rest, shrink back to the minimum
+    sleep_for(300);
+    oslock.lock();
+    cout << "Grew to " << peak << " threads (max 4), spawned " << (spawned > 0 ? "some" : "none")
+         << ", back to " << pool.num_threads() << " thread(s) at rest, retired as many as spawned: "
+         << (pool.retired_threads() == pool.spawned_threads() ? "yes" : "no") << "." << endl;
+    oslock.unlock();
+}
+
+static void cpuAffinityTest() {
+    // a made-up two-node machine
+    char dirTemplate[] = "/tmp/tpnodesXXXXXX";
+    string root = mkdtemp(dirTemplate);
+    const char *lists[] = {"0-1,4", "2-3,5-6\n"};
+    for (int node = 0; node < 2; node++) {
+        string dir = root + "/node" + to_string(node);
+        mkdir(dir.c_str(), 0755);
+        FILE *cpulist = fopen((dir + "/cpulist").c_str(), "w");
+        fputs(lists[node], cpulist);
+        fclose(cpulist);
+    }
+    CpuTopology fake = CpuTopology::read(root);
+    for (int node = 0; node < 2; node++) {
+        string dir = root + "/node" + to_string(node);
+        unlink((dir + "/cpulist").c_str());
+        rmdir(dir.c_str());
+    }
+    rmdir(root.c_str());
+
+    // pin every worker to the first CPU we may run on
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) cpu++;
+    ThreadPoolOptions options;
+    options.numThreads = 2;
+    options.cpus.push_back(cpu);
+    options.numaAware = true;
+    ThreadPool pool(options);
+    atomic<int> onCpu(0);
+    pool.schedule_n(100, [&](size_t) {
+        if (sched_getcpu() == cpu) onCpu++;
+    });
+    pool.wait();
+
+    // on the fake machine (where pinning fails harmlessly), per-node lanes
+    // and node-first stealing still have to run everything
+    ThreadPoolOptions numa;
+    numa.numThreads = 4;
+    numa.numaAware = true;
+    numa.topology = &fake;
+    ThreadPool numaPool(numa);
+    atomic<size_t> leaves(0);
+    function<void(int)> tree = [&](int depth) {
+        if (depth == 0) {
+            leaves++;
+            return;
+        }
+        numaPool.schedule([&, depth] { tree(depth - 1); });
+        numaPool.schedule([&, depth] { tree(depth - 1); }, depth % 2 ? kHighPriority : kLowPriority);
+    };
+    for (int i = 0; i < 4; i++) numaPool.schedule([&] { tree(10); });
+    numaPool.wait();
+
+    oslock.lock();
+    cout << "Fake machine: " << fake.numNodes() << " nodes (expected 2), cpu 4 on node "
+         << fake.nodeOf(4) << " and cpu 6 on node " << fake.nodeOf(6) << " (expected 0 and 1); "
+         << onCpu << " of 100 pinned thunks ran on cpu " << cpu << ", " << leaves
+         << " leaves on 2 nodes (expected 4096)." << endl;
+    oslock.unlock();
+}
+
+static void idlePolicyTest() {
+    const char *names[] = {"park", "spin-then-park", "adaptive"};
+    ThreadPoolOptions::IdlePolicy policies[] = {ThreadPoolOptions::kParkImmediately,
+                                                ThreadPoolOptions::kSpinThenPark,
+                                                ThreadPoolOptions::kAdaptiveSpin};
+    for (int k = 0; k < 3; k++) {
+        ThreadPoolOptions options;
+        options.numThreads = 4;
+        options.idlePolicy = policies[k];
+        ThreadPool pool(options);
+
+        // round trips, so workers keep going idle just before work arrives
+        Semaphore done;
+        size_t trips = 0;
+        for (int i = 0; i < 1000; i++) {
+            pool.schedule([&] { trips++; done.signal(); });
+            done.wait();
+        }
+        // and bursts with pauses in between, so they also go to sleep
+        atomic<size_t> leaves(0);
+        for (int burst = 0; burst < 5; burst++) {
+            for (int i = 0; i < 4; i++) pool.schedule([&] { spawnTree(pool, leaves, 8); });
+            pool.wait();
+            sleep_for(5);
+        }
+
+        oslock.lock();
+        cout << names[k] << ": " << trips << " round trips (expected 1000), " << leaves
+             << " leaves (expected 5120)." << endl;
+        oslock.unlock();
+    }
+}
+
+static void poolStatsTest() {
+    // buckets are ordered and hold their values to within 1/16
+    size_t badBuckets = 0;
+    for (uint64_t v = 1; v < (uint64_t(1) << 62); v = v * 3 + 1) {
+        size_t bucket = Histogram::bucketOf(v);
+        uint64_t high = Histogram::bucketHigh(bucket);
+        if (high < v || high - v > v / 16 || Histogram::bucketOf(high + 1) != bucket + 1) badBuckets++;
+    }
+    Histogram histogram;
+    for (uint64_t v = 1; v <= 1000; v++) histogram.record(v);
+    uint64_t median = histogram.percentile(50);
+
+    ThreadPool pool(2);
+    for (int i = 0; i < 100; i++) pool.schedule([] { sleep_for(1); });
+    pool.wait();
+    TaskGroup group(pool);
+    group.run_n(100, [](size_t) {});
+    group.wait();
+    pool.wait();    // the group's last thunk may not be recorded yet
+    PoolStats stats = pool.stats();
+
+    size_t tasks = stats.outside.tasks;
+    bool busy = true;
+    for (const PoolStats::WorkerTime& worker : stats.workers) {
+        tasks += worker.tasks;
+        if (worker.tasks > 0 && (worker.busy == 0 || worker.utilization() > 1)) busy = false;
+    }
+    ostringstream json;
+    stats.write_json(json);
+    oslock.lock();
+    cout << "Enabled " << stats.enabled << ", " << badBuckets << " bad buckets (expected 0), median of 1..1000 "
+         << (median >= 500 && median <= 500 + 500 / 16 ? "within 1/16" : "off") << ", ran "
+         << stats.runTime.count() << " (expected 200), " << tasks << " by thread (expected 200), "
+         << (stats.runTime.max() >= 1000000 ? "slowest took 1ms or more" : "too fast")
+         << ", waits " << stats.queueLatency.count() << " (expected 200), depth at most "
+         << (stats.queueDepth.max() <= 200 ? "200" : "more than 200") << ", busy times "
+         << (busy ? "fine" : "wrong") << ", JSON "
+         << (json.str().find("\"run_time_ns\": {\"count\": 200") != string::npos ? "has" : "lacks")
+         << " the run times." << endl;
+    oslock.unlock();
+}
+
+static void timersTest() {
+    typedef chrono::steady_clock clock;
+    ThreadPool pool(1);
+
+    // delays fire in order, not early, without holding the only worker
+    clock::time_point start = clock::now();
+    mutex orderLock;
+    vector<int> order;
+    bool early = false;
+    for (int delay : {30, 10, 20}) {
+        pool.schedule_after(chrono::milliseconds(delay), [&, delay] {
+            lock_guard<mutex> lock(orderLock);
+            order.push_back(delay);
+            early = early || clock::now() - start < chrono::milliseconds(delay);
+        });
+    }
+    Semaphore ranNow;
+    pool.schedule([&] { ranNow.signal(); });
+    bool notHeld = ranNow.wait_for(chrono::milliseconds(5));
+
+    // a cancelled timer never runs; a periodic one runs until cancelled
+    atomic<int> cancelledRan(0), ticks(0);
+    TimerId cancelled = pool.schedule_after(chrono::milliseconds(20), [&] { cancelledRan++; });
+    bool cancelledOnce = pool.cancel_timer(cancelled), cancelledTwice = pool.cancel_timer(cancelled);
+    TimerId periodic = pool.schedule_every(chrono::milliseconds(5), [&] { ticks++; });
+    sleep_for(60);
+    bool stopped = pool.cancel_timer(periodic);
+    int ticksAtCancel = ticks;
+    sleep_for(30);
+
+    // many timers, half of them cancelled. They go on a wheel of their own
+    // whose thread is held in a first thunk while they are added and
+    // cancelled, so none can fire before its cancellation, however slow
+    // that is
+    atomic<size_t> fired(0);
+    size_t cancelledMany = 0;
+    {
+        Semaphore holding, gate;
+        TimerWheel wheel(chrono::milliseconds(1), [](Thunk&& thunk) { thunk(); });
+        wheel.add(TimerWheel::Duration::zero(), TimerWheel::Duration::zero(),
+                  [&] { holding.signal(); gate.wait(); });
+        holding.wait();
+        vector<TimerId> ids;
+        for (int i = 0; i < 100000; i++) {
+            ids.push_back(wheel.add(chrono::microseconds(i % 50000), TimerWheel::Duration::zero(),
+                                    [&] { fired++; }));
+        }
+        for (size_t i = 1; i < ids.size(); i += 2) cancelledMany += wheel.cancel(ids[i]);
+        gate.signal();
+        while (wheel.size() > 0 && clock::now() - start < chrono::seconds(10)) sleep_for(10);
+    }    // the wheel's thread has dispatched everything due once it is joined
+
+    // and one far beyond the wheel
+    TimerId far = pool.schedule_after(chrono::hours(24 * 100), [&] { fired++; });
+    size_t pendingFar = pool.pending_timers();
+    bool farCancelled = pool.cancel_timer(far);
+
+    // a wheel with a tiny tick, to go through all its cascades quickly
+    atomic<size_t> onTime(0), late(0);
+    {
+        clock::time_point wheelStart = clock::now();
+        TimerWheel wheel(chrono::microseconds(1), [](Thunk&& thunk) { thunk(); });
+        for (int i = 0; i < 1000; i++) {
+            chrono::microseconds delay((i * 7919) % 300000);
+            wheel.add(delay, TimerWheel::Duration::zero(), [&, delay, wheelStart] {
+                (clock::now() - wheelStart >= delay ? onTime : late)++;
+            });
+        }
+        while (onTime + late < 1000 && clock::now() - wheelStart < chrono::seconds(10)) sleep_for(10);
+    }
+
+    // a timer added after the wheel sat idle does not wait for it to step
+    // through the idle ticks (5 million of them here)
+    chrono::microseconds idleLate(0);
+    {
+        TimerWheel wheel(chrono::nanoseconds(100), [](Thunk&& thunk) { thunk(); });
+        sleep_for(500);
+        Semaphore ranOnce;
+        clock::time_point added = clock::now(), ranAt;
+        wheel.add(TimerWheel::Duration::zero(), TimerWheel::Duration::zero(), [&] {
+            ranAt = clock::now();
+            ranOnce.signal();
+        });
+        ranOnce.wait();
+        idleLate = chrono::duration_cast<chrono::microseconds>(ranAt - added);
+    }
+
+    oslock.lock();
+    cout << "Order";
+    for (int delay : order) cout << " " << delay;
+    cout << " (expected 10 20 30), " << (early ? "some fired early" : "none early")
+         << ", worker " << (notHeld ? "free" : "held") << " meanwhile; cancel " << cancelledOnce
+         << cancelledTwice << " (expected 10), cancelled ran " << cancelledRan << "; periodic "
+         << (ticksAtCancel >= 5 ? "ticked" : "did not tick") << ", stopped " << stopped << ", "
+         << (ticks - ticksAtCancel <= 1 ? "no more ticks" : "kept ticking") << "; fired " << fired
+         << " of 100000 after cancelling " << cancelledMany << " (expected 50000), pending "
+         << pendingFar << " then far cancelled " << farCancelled << " (expected 1 and 1); wheel "
+         << onTime << " on time, " << late << " early (expected 1000 and 0); after idling "
+         << (idleLate < chrono::milliseconds(5) ? "on time" : "late") << "." << endl;
+    oslock.unlock();
+}
+
+static Task<int> addOnPool(ThreadPool& pool, int a, int b, atomic<int>& onWorker) {
+    co_await pool.schedule();
+    if (pool.is_worker_thread()) onWorker++;
+    co_return a + b;
+}
+
+static Task<int> addChain(ThreadPool& pool, atomic<int>& onWorker) {
+    int sum = 0;
+    for (int i = 1; i <= 10; i++) sum = co_await addOnPool(pool, sum, i, onWorker);
+    // the continuation runs where the last step finished: on the pool
+    if (pool.is_worker_thread()) onWorker++;
+    co_return sum;
+}
+
+static Task<> failOnPool(ThreadPool& pool) {
+    co_await pool.schedule();
+    throw runtime_error("coroutine boom");
+}
+
+static Task<size_t> hops(ThreadPool& pool, size_t count) {
+    size_t done = 0;
+    for (size_t i = 0; i < count; i++) {
+        co_await pool.schedule();
+        done++;
+    }
+    co_return done;
+}
+
+static void coroutinesTest() {
+    ThreadPool pool(2);
+    atomic<int> onWorker(0);
+    int sum = sync_wait(addChain(pool, onWorker));
+
+    string caught;
+    try {
+        sync_wait(failOnPool(pool));
+    } catch (const runtime_error& e) {
+        caught = e.what();
+    }
+
+    // many coroutines on a one-thread pool: suspended ones hold no thread
+    ThreadPool single(1);
+    atomic<size_t> hopped(0);
+    vector<thread> waiters;
+    for (int i = 0; i < 8; i++) {
+        waiters.push_back(thread([&] { hopped += sync_wait(hops(single, 1000)); }));
+    }
+    for (thread& waiter : waiters) waiter.join();
+
+    oslock.lock();
+    cout << "Sum " << sum << " (expected 55), " << onWorker << " of 11 steps on a worker, exception \""
+         << caught << "\", " << hopped << " hops (expected 8000)." << endl;
+    oslock.unlock();
+}
+
+/**
+ * @brief Builds a one-thread pool with room for 8 queued thunks, and
+ * holds its worker in a thunk until gate is signaled.
+ */
+static unique_ptr<ThreadPool> heldPool(ThreadPoolOptions::OverflowPolicy policy, Semaphore& gate) {
+    ThreadPoolOptions options;
+    options.numThreads = 1;
+    options.queueCapacity = 8;
+    options.overflowPolicy = policy;
+    unique_ptr<ThreadPool> pool(new ThreadPool(options));
+    Semaphore started;
+    pool->schedule([&started, &gate] { started.signal(); gate.wait(); });
+    started.wait();
+    return pool;
+}
+
+static void boundedQueueTest() {
+    atomic<size_t> ran(0);
+
+    // fail fast: the ninth thunk does not fit
+    Semaphore gate;
+    unique_ptr<ThreadPool> pool = heldPool(ThreadPoolOptions::kBlockWhenFull, gate);
+    size_t accepted = 0;
+    for (int i = 0; i < 9; i++) accepted += pool->try_schedule([&ran] { ran++; });
+    QueueStats full = pool->queue_stats();
+
+    // blocking: a producer of 100 more waits for room instead of queueing them
+    thread producer([&] {
+        for (int i = 0; i < 100; i++) pool->schedule([&ran] { ran++; });
+    });
+    sleep_for(50);
+    size_t queuedWhileBlocked = pool->queue_stats().depth;
+    gate.signal();
+    producer.join();
+    // a running thunk scheduling into the full queue runs what it schedules
+    atomic<size_t> children(0);
+    pool->schedule([&] {
+        for (int i = 0; i < 50; i++) pool->schedule([&children] { children++; });
+    });
+    pool->wait();
+    QueueStats blocking = pool->queue_stats();
+
+    // rejecting: schedule throws
+    Semaphore rejectGate;
+    pool = heldPool(ThreadPoolOptions::kRejectWhenFull, rejectGate);
+    string error;
+    try {
+        for (int i = 0; i < 9; i++) pool->schedule([&ran] { ran++; });
+    } catch (const runtime_error& e) {
+        error = e.what();
+    }
+    // due timers are let in even so
+    pool->schedule_after(chrono::milliseconds(1), [&ran] { ran++; });
+    for (int i = 0; i < 1000 && pool->queue_stats().depth < 9; i++) sleep_for(1);
+    size_t depthWithTimer = pool->queue_stats().depth;
+    rejectGate.signal();
+    pool->wait();
+
+    // caller runs: the ninth thunk runs on the scheduling thread
+    Semaphore callerGate;
+    pool = heldPool(ThreadPoolOptions::kRunInCaller, callerGate);
+    thread::id ranOn;
+    for (int i = 0; i < 8; i++) pool->schedule([&ran] { ran++; });
+    pool->schedule([&] { ranOn = this_thread::get_id(); });
+    QueueStats callerRuns = pool->queue_stats();
+    callerGate.signal();
+    pool->wait();
+
+    // co_await pool.schedule() still moves a coroutine to the pool when
+    // the queue is full, instead of resuming it inline or throwing
+    const ThreadPoolOptions::OverflowPolicy coPolicies[] = {ThreadPoolOptions::kRunInCaller,
+                                                            ThreadPoolOptions::kRejectWhenFull};
+    size_t coHops = 0, coQueued = 0;
+    string coError;
+    for (ThreadPoolOptions::OverflowPolicy policy : coPolicies) {
+        Semaphore coGate;
+        pool = heldPool(policy, coGate);
+        for (int i = 0; i < 8; i++) pool->schedule([&ran] { ran++; });
+        thread waiter([&] {
+            try {
+                coHops += sync_wait(hops(*pool, 1000));
+            } catch (const exception& e) {
+                coError = e.what();
+            }
+        });
+        for (int i = 0; i < 1000 && pool->queue_stats().depth < 9; i++) sleep_for(1);
+        coQueued += pool->queue_stats().depth == 9;
+        coGate.signal();
+        waiter.join();
+        pool->wait();
+    }
+
+    oslock.lock();
+    cout << "Fail fast: " << accepted << " of 9 accepted (expected 8), " << full.rejected
+         << " rejected (expected 1), depth " << full.depth << ". Blocking: " << queuedWhileBlocked
+         << " queued while the producer waited (expected 8), high water " << blocking.highWater
+         << " (expected 8), blocked " << (blocking.blocked > 0 ? "yes" : "no") << ", "
+         << children << " of 50 children ran. Rejecting: \"" << error << "\", " << depthWithTimer
+         << " queued with a due timer (expected 9). Caller runs: "
+         << (ranOn == this_thread::get_id() ? "on the caller" : "elsewhere") << ", "
+         << callerRuns.ranInCaller << " (expected 1). Coroutines: queued past a full queue "
+         << coQueued << " of 2 times, " << coHops << " hops (expected 2000)"
+         << (coError.empty() ? "" : ", threw \"" + coError + "\"") << ". Ran " << ran
+         << " (expected 141)." << endl;
+    oslock.unlock();
+}
+
 struct testEntry {
     string flag;
     function<void(void)> testfn;
@@ -106,6 +929,23 @@ static void buildMap(map<string, function<void(void)>>& testFunctionMap) {
         {"--single-thread-single-wait", singleThreadSingleWaitTest},
         {"--no-threads-double-wait", noThreadsDoubleWaitTest},
         {"--reuse-thread-pool", reuseThreadPoolTest},
+        {"--nested-schedule", nestedScheduleTest},
+        {"--ring-queue", ringQueueTest},
+        {"--move-only-thunk", moveOnlyThunkTest},
+        {"--submit-futures", submitFuturesTest},
+        {"--bulk-schedule", bulkScheduleTest},
+        {"--parallel-loops", parallelLoopsTest},
+        {"--semaphore", semaphoreTest},
+        {"--task-group", taskGroupTest},
+        {"--task-graph", taskGraphTest},
+        {"--priority-lanes", priorityLanesTest},
+        {"--elastic-pool", elasticPoolTest},
+        {"--cpu-affinity", cpuAffinityTest},
+        {"--idle-policy", idlePolicyTest},
+        {"--pool-stats", poolStatsTest},
+        {"--timers", timersTest},
+        {"--coroutines", coroutinesTest},
+        {"--bounded-queue", boundedQueueTest},
         {"--s", simpleTest},
     };
 
@@ -0,0 +1,154 @@
+/**
+ * File: work-stealing-deque.h
+ * ---------------------------
+ * Defines WorkStealingDeque, the Chase-Lev deque each ThreadPool worker
+ * keeps its own thunks in. The owning thread pushes and pops at the
+ * bottom without taking a lock; any other thread may steal from the top.
+ *
+ * The memory orderings follow "Correct and Efficient Work-Stealing for
+ * Weak Memory Models" (Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013).
+ */
+
+#ifndef _work_stealing_deque_
+#define _work_stealing_deque_
+
+#include <atomic>    // for atomic
+#include <cstddef>   // for size_t
+#include <cstdint>   // for int64_t
+#include <vector>    // for vector
+
+using namespace std;
+
+/**
+ * @brief Size of a cache line, used to keep the owner's and the thieves'
+ * hot indices apart.
+ */
+static const size_t kCacheLineSize = 64;
+
+template <typename T>
+class WorkStealingDeque {
+  public:
+
+  /**
+  * Constructs an empty deque able to hold capacity items (rounded up
+  * to a power of two) before it has to grow.
+  */
+    explicit WorkStealingDeque(size_t capacity = 256) : top_(0), bottom_(0) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        array_.store(new Array(size), memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque() {
+        delete array_.load(memory_order_relaxed);
+        for (Array *old : retired_) delete old;
+    }
+
+  /**
+  * Pushes item at the bottom. Only the owning thread may call this.
+  */
+    void push(T *item) {
+        int64_t b = bottom_.load(memory_order_relaxed);
+        int64_t t = top_.load(memory_order_acquire);
+        Array *a = array_.load(memory_order_relaxed);
+        if (b - t > (int64_t)a->size() - 1) {
+            a = grow(a, t, b);
+        }
+        a->put(b, item);
+        atomic_thread_fence(memory_order_release);
+        bottom_.store(b + 1, memory_order_relaxed);
+    }
+
+  /**
+  * Pops the most recently pushed item, or returns nullptr when the deque
+  * is empty. Only the owning thread may call this.
+  */
+    T *pop() {
+        int64_t b = bottom_.load(memory_order_relaxed) - 1;
+        Array *a = array_.load(memory_order_relaxed);
+        bottom_.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top_.load(memory_order_relaxed);
+
+        T *item = nullptr;
+        if (t <= b) {
+            item = a->get(b);
+            if (t == b) {
+                // last item: race the thieves for it
+                if (!top_.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                                  memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom_.store(b + 1, memory_order_relaxed);
+            }
+        } else {
+            bottom_.store(b + 1, memory_order_relaxed);
+        }
+        return item;
+    }
+
+  /**
+  * Takes the oldest item. Returns nullptr when the deque is empty or
+  * another thread won the race for that item, so callers simply move on
+  * to the next victim. Any thread may call this.
+  */
+    T *steal() {
+        int64_t t = top_.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom_.load(memory_order_acquire);
+
+        if (t >= b) return nullptr;
+        Array *a = array_.load(memory_order_acquire);
+        T *item = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                          memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+  /**
+  * Approximate emptiness check, exact only when no other thread is
+  * touching the deque.
+  */
+    bool empty() const {
+        return bottom_.load(memory_order_relaxed) <= top_.load(memory_order_relaxed);
+    }
+
+  private:
+    class Array {
+      public:
+        explicit Array(size_t size) : mask_(size - 1), slots_(new atomic<T *>[size]) {}
+        ~Array() { delete[] slots_; }
+        size_t size() const { return mask_ + 1; }
+        T *get(int64_t i) const { return slots_[i & mask_].load(memory_order_relaxed); }
+        void put(int64_t i, T *item) { slots_[i & mask_].store(item, memory_order_relaxed); }
+
+      private:
+        size_t mask_;
+        atomic<T *> *slots_;
+    };
+
+    // Doubles the array. The old one may still be read by a thief that
+    // loaded it before the switch, so it is kept until the deque dies.
+    Array *grow(Array *old, int64_t t, int64_t b) {
+        Array *a = new Array(old->size() * 2);
+        for (int64_t i = t; i < b; i++) a->put(i, old->get(i));
+        retired_.push_back(old);
+        array_.store(a, memory_order_release);
+        return a;
+    }
+
+    // thieves hammer top_, the owner bottom_: keep them on separate lines
+    atomic<int64_t> top_;
+    char padTop_[kCacheLineSize - sizeof(atomic<int64_t>)];
+    atomic<int64_t> bottom_;
+    char padBottom_[kCacheLineSize - sizeof(atomic<int64_t>)];
+    atomic<Array *> array_;
+    vector<Array *> retired_;
+
+    WorkStealingDeque(const WorkStealingDeque& original) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque& rhs) = delete;
+};
+
+#endif